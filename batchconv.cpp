@@ -0,0 +1,523 @@
+// Batch texture converter: bakes many images into texconv containers at
+// once. Each image goes through four stages, each with its own threads
+// and joined by bounded queues, so reading, filtering, compressing and
+// writing different images overlap and at most a fixed number of images
+// is ever in memory, however many inputs there are.
+//
+//   ./batchconv [--bgra | --bc1 | --bc3] [--fast] [--no-mips] [--max N]
+//               [--threads N] [--queue N] [--overwrite] -o outdir inputs...
+//
+// decode   maps the file and decodes it to RGBA with decode_image
+// resample scales it to fit --max and builds the mip chain (SSE2)
+// convert  swizzles to BGRA or encodes BC1/BC3
+// write    writes outdir/<name>.tex
+//
+// Inputs whose names would collide in outdir are refused up front, and an
+// existing output counts as a failure unless --overwrite is given.
+
+#include "texture_file.h"
+#include "bc_encode.h"
+#include "image_arena.h"
+#include "stb_image.h"
+#include "vfs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <emmintrin.h>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#define BATCH_MAX_THREADS 32
+#define BATCH_DEFAULT_QUEUE 4
+
+struct image_job {
+  const char *path;
+  int width, height;
+  int level_count;
+  texture_file_level levels[TEXTURE_FILE_MAX_LEVELS];
+  unsigned char *pixels[TEXTURE_FILE_MAX_LEVELS];
+};
+
+// Fixed-size ring of jobs. push blocks while it is full, which is what
+// bounds memory: a slow stage stalls the ones feeding it.
+struct job_queue {
+  image_job **items;
+  int capacity, head, count;
+  int producers;
+  std::mutex lock;
+  std::condition_variable not_empty, not_full;
+};
+
+struct stage_stats {
+  const char *name;
+  std::atomic<long> items;
+  std::atomic<long long> busy_ns;
+  std::atomic<long long> bytes;
+};
+
+struct batch_options {
+  int format;
+  bc_mode mode;
+  int mips;
+  int max_size;
+  int overwrite;
+  const char *output_dir;
+};
+
+struct batch {
+  batch_options options;
+  const char **inputs;
+  int input_count;
+  std::atomic<int> next_input;
+  std::atomic<int> failed;
+  std::atomic<int> in_flight, peak_in_flight;
+  job_queue decoded, resampled, converted;
+  stage_stats decode, resample, convert, write;
+};
+
+static long long now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ll + ts.tv_nsec;
+}
+
+static void queue_init(job_queue *q, int capacity, int producers) {
+  q->items = (image_job **)malloc(capacity * sizeof(image_job *));
+  q->capacity = capacity;
+  q->head = q->count = 0;
+  q->producers = producers;
+}
+
+static void queue_push(job_queue *q, image_job *job) {
+  std::unique_lock<std::mutex> hold(q->lock);
+  q->not_full.wait(hold, [q] { return q->count < q->capacity; });
+  q->items[(q->head + q->count) % q->capacity] = job;
+  q->count++;
+  q->not_empty.notify_one();
+}
+
+// Returns NULL once every producer has finished and the queue is empty.
+static image_job *queue_pop(job_queue *q) {
+  std::unique_lock<std::mutex> hold(q->lock);
+  q->not_empty.wait(hold, [q] { return q->count || !q->producers; });
+  if(!q->count)
+    return NULL;
+  image_job *job = q->items[q->head];
+  q->head = (q->head + 1) % q->capacity;
+  q->count--;
+  q->not_full.notify_one();
+  return job;
+}
+
+static void queue_producer_done(job_queue *q) {
+  std::lock_guard<std::mutex> hold(q->lock);
+  if(--q->producers == 0)
+    q->not_empty.notify_all();
+}
+
+static void record(stage_stats *s, long long start, size_t bytes) {
+  s->items++;
+  s->busy_ns += now_ns() - start;
+  s->bytes += bytes;
+}
+
+// Every buffer a job holds comes from image_arena_malloc, which is the
+// plain heap outside decode_image, so the decoded level and the ones made
+// later are released the same way.
+static unsigned char *job_alloc(size_t size) {
+  return (unsigned char *)image_arena_malloc(size);
+}
+
+static void free_job(batch *b, image_job *job) {
+  for(int i=0;i<job->level_count;i++)
+    image_arena_free(job->pixels[i]);
+  free(job);
+  b->in_flight--;
+}
+
+static void fail_job(batch *b, image_job *job) {
+  b->failed++;
+  free_job(b, job);
+}
+
+// ---------------------------------------------------------------- resample
+
+// Separable tent filter. For each output texel, the source indices
+// (clamped to the edge) and normalized weights of its taps.
+struct filter_taps {
+  int count;
+  int *index;
+  float *weight;
+};
+
+static filter_taps make_taps(int src, int dst) {
+  filter_taps t;
+  float scale = (float)src / dst;
+  float support = scale > 1 ? scale : 1;
+  t.count = (int)ceilf(support) * 2 + 1;
+  t.index = (int *)malloc((size_t)dst * t.count * sizeof(int));
+  t.weight = (float *)malloc((size_t)dst * t.count * sizeof(float));
+  for(int i=0;i<dst;i++) {
+    float center = (i + 0.5f) * scale - 0.5f;
+    int first = (int)floorf(center) - t.count / 2 + 1;
+    float total = 0;
+    for(int k=0;k<t.count;k++) {
+      int j = first + k;
+      float w = 1 - fabsf(j - center) / support;
+      w = w > 0 ? w : 0;
+      t.index[i*t.count + k] = j < 0 ? 0 : j >= src ? src - 1 : j;
+      t.weight[i*t.count + k] = w;
+      total += w;
+    }
+    for(int k=0;k<t.count;k++)
+      t.weight[i*t.count + k] /= total;
+  }
+  return t;
+}
+
+static void free_taps(filter_taps *t) {
+  free(t->index);
+  free(t->weight);
+}
+
+static __m128 load_texel(const unsigned char *p) {
+  __m128i zero = _mm_setzero_si128();
+  __m128i v = _mm_cvtsi32_si128(*(const int *)p);
+  v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(v, zero), zero);
+  return _mm_cvtepi32_ps(v);
+}
+
+static void store_texel(unsigned char *p, __m128 v) {
+  __m128i i = _mm_cvtps_epi32(v);
+  i = _mm_packs_epi32(i, i);
+  i = _mm_packus_epi16(i, i);
+  *(int *)p = _mm_cvtsi128_si32(i);
+}
+
+static void filter_row(const unsigned char *in, const filter_taps *h, int dw, __m128 *out) {
+  for(int x=0;x<dw;x++) {
+    const int *index = h->index + x*h->count;
+    const float *weight = h->weight + x*h->count;
+    __m128 sum = _mm_setzero_ps();
+    for(int k=0;k<h->count;k++)
+      sum = _mm_add_ps(sum, _mm_mul_ps(load_texel(in + index[k]*4), _mm_set1_ps(weight[k])));
+    out[x] = sum;
+  }
+}
+
+// Resizes RGBA8 'src' into 'dst'. Source rows are filtered horizontally
+// into float RGBA as the vertical pass first needs them, into a ring just
+// deep enough for one output row's taps; each texel's four channels are
+// one SSE vector throughout.
+static void resample(const unsigned char *src, int sw, int sh, unsigned char *dst, int dw, int dh) {
+  filter_taps h = make_taps(sw, dw), v = make_taps(sh, dh);
+  __m128 *ring = (__m128 *)_mm_malloc((size_t)dw * v.count * sizeof(__m128), 16);
+  int *ring_row = (int *)malloc(v.count * sizeof(int));
+  for(int i=0;i<v.count;i++)
+    ring_row[i] = -1;
+  __m128 *line = (__m128 *)_mm_malloc((size_t)dw * sizeof(__m128), 16);
+
+  for(int y=0;y<dh;y++) {
+    const int *index = v.index + y*v.count;
+    const float *weight = v.weight + y*v.count;
+    for(int x=0;x<dw;x++)
+      line[x] = _mm_setzero_ps();
+    for(int k=0;k<v.count;k++) {
+      if(weight[k] == 0)
+        continue;
+      int r = index[k], slot = r % v.count;
+      __m128 *row = ring + (size_t)slot * dw;
+      if(ring_row[slot] != r) {
+        filter_row(src + (size_t)r * sw * 4, &h, dw, row);
+        ring_row[slot] = r;
+      }
+      __m128 w = _mm_set1_ps(weight[k]);
+      for(int x=0;x<dw;x++)
+        line[x] = _mm_add_ps(line[x], _mm_mul_ps(row[x], w));
+    }
+    unsigned char *out = dst + (size_t)y * dw * 4;
+    for(int x=0;x<dw;x++)
+      store_texel(out + x*4, line[x]);
+  }
+
+  _mm_free(line);
+  _mm_free(ring);
+  free(ring_row);
+  free_taps(&h);
+  free_taps(&v);
+}
+
+static unsigned char *resized(const unsigned char *src, int sw, int sh, int dw, int dh) {
+  unsigned char *dst = job_alloc((size_t)dw * dh * 4);
+  resample(src, sw, sh, dst, dw, dh);
+  return dst;
+}
+
+// ---------------------------------------------------------------- stages
+
+static void decode_stage(batch *b) {
+  for(;;) {
+    int i = b->next_input++;
+    if(i >= b->input_count)
+      break;
+    long long start = now_ns();
+    vfs_file file;
+    if(!vfs_open(b->inputs[i], &file)) {
+      fprintf(stderr, "Unable to open %s for reading\n", b->inputs[i]);
+      b->failed++;
+      continue;
+    }
+    vfs_advise(&file, MADV_SEQUENTIAL);
+    int w, h, channels;
+    unsigned char *pixels = decode_image((const unsigned char *)file.data, (int)file.size, &w, &h, &channels, 4);
+    size_t file_bytes = file.size;
+    vfs_close(&file);
+    if(!pixels) {
+      fprintf(stderr, "%s: %s\n", b->inputs[i], stbi_failure_reason());
+      b->failed++;
+      continue;
+    }
+
+    image_job *job = (image_job *)calloc(1, sizeof(image_job));
+    job->path = b->inputs[i];
+    job->width = w;
+    job->height = h;
+    job->level_count = 1;
+    job->pixels[0] = pixels;
+    int live = ++b->in_flight;
+    int peak = b->peak_in_flight;
+    while(live > peak && !b->peak_in_flight.compare_exchange_weak(peak, live)) {}
+    record(&b->decode, start, file_bytes);
+    queue_push(&b->decoded, job);
+  }
+  image_arena_release();
+  queue_producer_done(&b->decoded);
+}
+
+static void resample_stage(batch *b) {
+  while(image_job *job = queue_pop(&b->decoded)) {
+    long long start = now_ns();
+    int w = job->width, h = job->height;
+    int max_size = b->options.max_size;
+    if(max_size > 0 && (w > max_size || h > max_size)) {
+      int dw = w >= h ? max_size : (int)((long long)w * max_size / h);
+      int dh = h >= w ? max_size : (int)((long long)h * max_size / w);
+      dw = dw > 0 ? dw : 1;
+      dh = dh > 0 ? dh : 1;
+      unsigned char *scaled = resized(job->pixels[0], w, h, dw, dh);
+      image_arena_free(job->pixels[0]);
+      job->pixels[0] = scaled;
+      w = dw;
+      h = dh;
+    }
+    job->levels[0].width = w;
+    job->levels[0].height = h;
+    job->levels[0].size = (size_t)w * h * 4;
+
+    while(b->options.mips && job->level_count < TEXTURE_FILE_MAX_LEVELS && (w > 1 || h > 1)) {
+      int dw = w > 1 ? w / 2 : 1, dh = h > 1 ? h / 2 : 1;
+      int l = job->level_count++;
+      job->pixels[l] = resized(job->pixels[l-1], w, h, dw, dh);
+      job->levels[l].width = w = dw;
+      job->levels[l].height = h = dh;
+      job->levels[l].size = (size_t)w * h * 4;
+    }
+    record(&b->resample, start, (size_t)job->width * job->height * 4);
+    queue_push(&b->resampled, job);
+  }
+  queue_producer_done(&b->resampled);
+}
+
+static void convert_stage(batch *b) {
+  int format = b->options.format;
+  while(image_job *job = queue_pop(&b->resampled)) {
+    long long start = now_ns();
+    size_t bytes = 0;
+    for(int i=0;i<job->level_count;i++) {
+      texture_file_level *lv = &job->levels[i];
+      bytes += lv->size;
+      if(format == TEXTURE_FORMAT_BGRA8) {
+        unsigned char *p = job->pixels[i];
+        for(size_t k=0;k<lv->size;k+=4) {
+          unsigned char t = p[k];
+          p[k] = p[k+2];
+          p[k+2] = t;
+        }
+      } else if(format == TEXTURE_FORMAT_BC1 || format == TEXTURE_FORMAT_BC3) {
+        int block_bytes = format == TEXTURE_FORMAT_BC1 ? BC1_BLOCK_BYTES : BC3_BLOCK_BYTES;
+        size_t size = bc_image_size(lv->width, lv->height, block_bytes);
+        unsigned char *blocks = job_alloc(size);
+        if(format == TEXTURE_FORMAT_BC1)
+          encode_bc1_image(job->pixels[i], lv->width, lv->height, 4, blocks, b->options.mode);
+        else
+          encode_bc3_image(job->pixels[i], lv->width, lv->height, 4, blocks, b->options.mode);
+        image_arena_free(job->pixels[i]);
+        job->pixels[i] = blocks;
+        lv->size = size;
+      }
+    }
+    record(&b->convert, start, bytes);
+    queue_push(&b->converted, job);
+  }
+  queue_producer_done(&b->converted);
+}
+
+// outdir/<stem>.tex for an input; the input's directory is dropped.
+static void output_path(const char *output_dir, const char *input, char *path, size_t size) {
+  const char *name = strrchr(input, '/');
+  name = name ? name + 1 : input;
+  const char *dot = strrchr(name, '.');
+  int stem = dot ? (int)(dot - name) : (int)strlen(name);
+  snprintf(path, size, "%s/%.*s.tex", output_dir, stem, name);
+}
+
+static void write_stage(batch *b) {
+  while(image_job *job = queue_pop(&b->converted)) {
+    long long start = now_ns();
+    char path[1024];
+    output_path(b->options.output_dir, job->path, path, sizeof(path));
+    if(!b->options.overwrite && access(path, F_OK) == 0) {
+      fprintf(stderr, "%s: %s already exists, not overwriting\n", job->path, path);
+      fail_job(b, job);
+      continue;
+    }
+
+    uint64_t bytes = write_texture_file(path, b->options.format, job->levels,
+                                        (const unsigned char *const *)job->pixels, job->level_count);
+    if(!bytes) {
+      fail_job(b, job);
+      continue;
+    }
+    record(&b->write, start, bytes);
+    free_job(b, job);
+  }
+}
+
+// ---------------------------------------------------------------- main
+
+struct named_input {
+  char path[1024];
+  const char *input;
+};
+
+static int compare_named_inputs(const void *a, const void *b) {
+  return strcmp(((const named_input *)a)->path, ((const named_input *)b)->path);
+}
+
+// Two inputs with the same stem would write the same file; report every
+// such pair rather than let one silently replace the other.
+static int unique_outputs(const char *output_dir, const char **inputs, int count) {
+  named_input *names = (named_input *)malloc(count * sizeof(named_input));
+  for(int i=0;i<count;i++) {
+    output_path(output_dir, inputs[i], names[i].path, sizeof(names[i].path));
+    names[i].input = inputs[i];
+  }
+  qsort(names, count, sizeof(named_input), compare_named_inputs);
+  int unique = 1;
+  for(int i=1;i<count;i++) {
+    if(!strcmp(names[i].path, names[i-1].path)) {
+      fprintf(stderr, "%s and %s both write %s\n", names[i-1].input, names[i].input, names[i].path);
+      unique = 0;
+    }
+  }
+  free(names);
+  return unique;
+}
+
+// Rates are per busy thread-second, so a stage that mostly waits on its
+// queue still shows its real speed; utilization shows how much it waited.
+static void report_stage(const stage_stats *s, int threads, double wall) {
+  double busy = s->busy_ns / 1e9;
+  double per = busy > 0 ? 1 / busy : 0;
+  fprintf(stderr, "  %-8s %2d threads %6ld images %8.1f images/s %8.1f MB/s %4.0f%% busy\n",
+          s->name, threads, s->items.load(), s->items * per, s->bytes / (1024.0 * 1024.0) * per,
+          wall > 0 ? busy / (wall * threads) * 100 : 0);
+}
+
+int main(int argc, char **argv) {
+  // Static so the atomics and locks start out zeroed.
+  static batch run;
+  batch *b = &run;
+  b->options.format = TEXTURE_FORMAT_RGBA8;
+  b->options.mode = BC_QUALITY;
+  b->options.mips = 1;
+  b->options.max_size = 0;
+  b->options.overwrite = 0;
+  b->options.output_dir = NULL;
+  int threads = 0, queue = BATCH_DEFAULT_QUEUE;
+  const char **inputs = (const char **)malloc(argc * sizeof(char *));
+  int count = 0;
+  for(int i=1;i<argc;i++) {
+    if(!strcmp(argv[i], "--bgra")) b->options.format = TEXTURE_FORMAT_BGRA8;
+    else if(!strcmp(argv[i], "--bc1")) b->options.format = TEXTURE_FORMAT_BC1;
+    else if(!strcmp(argv[i], "--bc3")) b->options.format = TEXTURE_FORMAT_BC3;
+    else if(!strcmp(argv[i], "--fast")) b->options.mode = BC_FAST;
+    else if(!strcmp(argv[i], "--no-mips")) b->options.mips = 0;
+    else if(!strcmp(argv[i], "--max") && i + 1 < argc) b->options.max_size = atoi(argv[++i]);
+    else if(!strcmp(argv[i], "--threads") && i + 1 < argc) threads = atoi(argv[++i]);
+    else if(!strcmp(argv[i], "--queue") && i + 1 < argc) queue = atoi(argv[++i]);
+    else if(!strcmp(argv[i], "--overwrite")) b->options.overwrite = 1;
+    else if(!strcmp(argv[i], "-o") && i + 1 < argc) b->options.output_dir = argv[++i];
+    else inputs[count++] = argv[i];
+  }
+  if(!b->options.output_dir || !count) {
+    fprintf(stderr, "usage: %s [--bgra | --bc1 | --bc3] [--fast] [--no-mips] [--max N]\n"
+            "       [--threads N] [--queue N] [--overwrite] -o outdir inputs...\n", argv[0]);
+    return 1;
+  }
+  if(!unique_outputs(b->options.output_dir, inputs, count)) {
+    free(inputs);
+    return 1;
+  }
+  if(threads <= 0)
+    threads = std::thread::hardware_concurrency();
+  threads = threads < 1 ? 1 : threads > BATCH_MAX_THREADS ? BATCH_MAX_THREADS : threads;
+  queue = queue < 1 ? 1 : queue;
+
+  b->inputs = inputs;
+  b->input_count = count;
+  b->decode.name = "decode";
+  b->resample.name = "resample";
+  b->convert.name = "convert";
+  b->write.name = "write";
+  queue_init(&b->decoded, queue, threads);
+  queue_init(&b->resampled, queue, threads);
+  queue_init(&b->converted, queue, threads);
+
+  // Decoding and compressing are the CPU-heavy stages; one writer is
+  // plenty to keep up with them.
+  long long start = now_ns();
+  std::thread workers[3 * BATCH_MAX_THREADS + 1];
+  int n = 0;
+  for(int i=0;i<threads;i++) {
+    workers[n++] = std::thread(decode_stage, b);
+    workers[n++] = std::thread(resample_stage, b);
+    workers[n++] = std::thread(convert_stage, b);
+  }
+  workers[n++] = std::thread(write_stage, b);
+  for(int i=0;i<n;i++)
+    workers[i].join();
+  double wall = (now_ns() - start) / 1e9;
+
+  fprintf(stderr, "%ld of %d images in %.2f s (%.1f images/s), at most %d in memory\n",
+          b->write.items.load(), count, wall, b->write.items / (wall > 0 ? wall : 1e-9),
+          b->peak_in_flight.load());
+  report_stage(&b->decode, threads, wall);
+  report_stage(&b->resample, threads, wall);
+  report_stage(&b->convert, threads, wall);
+  report_stage(&b->write, 1, wall);
+  image_arena_report();
+
+  int failed = b->failed;
+  free(b->decoded.items);
+  free(b->resampled.items);
+  free(b->converted.items);
+  free(inputs);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,309 @@
+#include "bc_encode.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <emmintrin.h>
+
+// Tightens the fast-mode bounding box by 1/16 of its extent on each side;
+// the extreme texels are rarely worth an exact endpoint.
+#define BC_INSET_SHIFT 4
+#define BC_REFINE_ITERATIONS 2
+
+size_t bc_image_size(int width, int height, int block_bytes) {
+  size_t bw = (width + 3) / 4, bh = (height + 3) / 4;
+  return (bw ? bw : 1) * (bh ? bh : 1) * block_bytes;
+}
+
+// Gathers the 4x4 block at (bx, by) as RGBA, repeating the last row and
+// column where the block hangs off the image edge.
+static void load_block(const unsigned char *pixels, int width, int height, int channels,
+                       int bx, int by, unsigned char block[64]) {
+  for(int y=0;y<4;y++) {
+    int sy = by + y < height ? by + y : height - 1;
+    for(int x=0;x<4;x++) {
+      int sx = bx + x < width ? bx + x : width - 1;
+      const unsigned char *p = pixels + ((size_t)sy * width + sx) * channels;
+      unsigned char *d = block + (y*4 + x)*4;
+      d[0] = p[0];
+      d[1] = p[1];
+      d[2] = p[2];
+      d[3] = channels == 4 ? p[3] : 255;
+    }
+  }
+}
+
+static int to565(int r, int g, int b) {
+  return ((r*31 + 127) / 255) << 11 | ((g*63 + 127) / 255) << 5 | (b*31 + 127) / 255;
+}
+
+static void from565(int c, int rgb[3]) {
+  int r = c >> 11 & 31, g = c >> 5 & 63, b = c & 31;
+  rgb[0] = r << 3 | r >> 2;
+  rgb[1] = g << 2 | g >> 4;
+  rgb[2] = b << 3 | b >> 2;
+}
+
+static int clamp_byte(float v) {
+  return v < 0 ? 0 : v > 255 ? 255 : (int)(v + 0.5f);
+}
+
+// Picks the nearest of the four palette colours for all 16 texels, four
+// at a time, and returns the summed squared error. Alpha is ignored.
+static int fit_indices(const unsigned char block[64], const int palette[4][3], unsigned int *indices) {
+  __m128i colors[4];
+  for(int k=0;k<4;k++)
+    colors[k] = _mm_set1_epi32(palette[k][0] | palette[k][1] << 8 | palette[k][2] << 16);
+  const __m128i rgb_mask = _mm_set1_epi32(0x00FFFFFF);
+  const __m128i zero = _mm_setzero_si128();
+
+  unsigned int bits = 0;
+  __m128i error = zero;
+  for(int row=0;row<4;row++) {
+    __m128i p = _mm_and_si128(_mm_loadu_si128((const __m128i *)(block + row*16)), rgb_mask);
+    __m128i best = _mm_set1_epi32(0x7FFFFFFF), index = zero;
+    for(int k=0;k<4;k++) {
+      __m128i d = _mm_or_si128(_mm_subs_epu8(p, colors[k]), _mm_subs_epu8(colors[k], p));
+      __m128i lo = _mm_unpacklo_epi8(d, zero), hi = _mm_unpackhi_epi8(d, zero);
+      lo = _mm_madd_epi16(lo, lo);
+      hi = _mm_madd_epi16(hi, hi);
+      lo = _mm_add_epi32(lo, _mm_shuffle_epi32(lo, _MM_SHUFFLE(2, 3, 0, 1)));
+      hi = _mm_add_epi32(hi, _mm_shuffle_epi32(hi, _MM_SHUFFLE(2, 3, 0, 1)));
+      __m128i dist = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(2, 0, 2, 0)));
+      __m128i closer = _mm_cmplt_epi32(dist, best);
+      best = _mm_or_si128(_mm_and_si128(closer, dist), _mm_andnot_si128(closer, best));
+      index = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(k)), _mm_andnot_si128(closer, index));
+    }
+    error = _mm_add_epi32(error, best);
+    // Fold the four 2-bit indices of this row into bits 8*row..8*row+7.
+    index = _mm_or_si128(index, _mm_srli_epi64(index, 30));
+    unsigned int packed = _mm_cvtsi128_si32(index) | _mm_cvtsi128_si32(_mm_srli_si128(index, 8)) << 4;
+    bits |= (packed & 0xFF) << (row*8);
+  }
+  error = _mm_add_epi32(error, _mm_shuffle_epi32(error, _MM_SHUFFLE(1, 0, 3, 2)));
+  error = _mm_add_epi32(error, _mm_shuffle_epi32(error, _MM_SHUFFLE(2, 3, 0, 1)));
+  *indices = bits;
+  return _mm_cvtsi128_si32(error);
+}
+
+// Quantizes two endpoint colours, orders them for four-colour mode and
+// fits indices. Returns the block error.
+static int emit_color_block(const unsigned char block[64], const int e0[3], const int e1[3], unsigned char out[8]) {
+  int c0 = to565(e0[0], e0[1], e0[2]);
+  int c1 = to565(e1[0], e1[1], e1[2]);
+  if(c0 < c1) {
+    int t = c0; c0 = c1; c1 = t;
+  }
+
+  unsigned int indices = 0;
+  int error;
+  int palette[4][3];
+  from565(c0, palette[0]);
+  from565(c1, palette[1]);
+  if(c0 == c1) {
+    // Equal endpoints would select three-colour mode; index 0 everywhere
+    // is the only safe choice.
+    memcpy(palette[2], palette[0], sizeof(palette[2]));
+    memcpy(palette[3], palette[0], sizeof(palette[3]));
+    error = fit_indices(block, palette, &indices);
+    indices = 0;
+  } else {
+    for(int k=0;k<3;k++) {
+      palette[2][k] = (2*palette[0][k] + palette[1][k]) / 3;
+      palette[3][k] = (palette[0][k] + 2*palette[1][k]) / 3;
+    }
+    error = fit_indices(block, palette, &indices);
+  }
+
+  out[0] = c0 & 0xFF; out[1] = c0 >> 8;
+  out[2] = c1 & 0xFF; out[3] = c1 >> 8;
+  out[4] = indices & 0xFF; out[5] = indices >> 8 & 0xFF;
+  out[6] = indices >> 16 & 0xFF; out[7] = indices >> 24;
+  return error;
+}
+
+static void bounding_box(const unsigned char block[64], int lo[4], int hi[4]) {
+  __m128i r0 = _mm_loadu_si128((const __m128i *)block);
+  __m128i r1 = _mm_loadu_si128((const __m128i *)(block + 16));
+  __m128i r2 = _mm_loadu_si128((const __m128i *)(block + 32));
+  __m128i r3 = _mm_loadu_si128((const __m128i *)(block + 48));
+  __m128i mn = _mm_min_epu8(_mm_min_epu8(r0, r1), _mm_min_epu8(r2, r3));
+  __m128i mx = _mm_max_epu8(_mm_max_epu8(r0, r1), _mm_max_epu8(r2, r3));
+  mn = _mm_min_epu8(mn, _mm_shuffle_epi32(mn, _MM_SHUFFLE(1, 0, 3, 2)));
+  mn = _mm_min_epu8(mn, _mm_shuffle_epi32(mn, _MM_SHUFFLE(2, 3, 0, 1)));
+  mx = _mm_max_epu8(mx, _mm_shuffle_epi32(mx, _MM_SHUFFLE(1, 0, 3, 2)));
+  mx = _mm_max_epu8(mx, _mm_shuffle_epi32(mx, _MM_SHUFFLE(2, 3, 0, 1)));
+  unsigned int a = _mm_cvtsi128_si32(mn), b = _mm_cvtsi128_si32(mx);
+  for(int k=0;k<4;k++) {
+    lo[k] = a >> (8*k) & 0xFF;
+    hi[k] = b >> (8*k) & 0xFF;
+  }
+}
+
+static void color_block_fast(const unsigned char block[64], unsigned char out[8]) {
+  int lo[4], hi[4];
+  bounding_box(block, lo, hi);
+  for(int k=0;k<3;k++) {
+    int inset = (hi[k] - lo[k]) >> BC_INSET_SHIFT;
+    lo[k] += inset;
+    hi[k] -= inset;
+  }
+  emit_color_block(block, hi, lo, out);
+}
+
+// Solves for the endpoints that best reproduce the block given the
+// palette weights its current indices imply.
+static int refine_endpoints(const unsigned char block[64], unsigned int indices, int e0[3], int e1[3]) {
+  static const float weight[4] = { 1.0f, 0.0f, 2.0f/3, 1.0f/3 };
+  float aa = 0, ab = 0, bb = 0, ax[3] = { 0, 0, 0 }, bx[3] = { 0, 0, 0 };
+  for(int i=0;i<16;i++) {
+    float a = weight[indices >> (2*i) & 3], b = 1 - a;
+    aa += a*a; ab += a*b; bb += b*b;
+    for(int k=0;k<3;k++) {
+      ax[k] += a * block[i*4 + k];
+      bx[k] += b * block[i*4 + k];
+    }
+  }
+  float det = aa*bb - ab*ab;
+  if(fabsf(det) < 1e-6f)
+    return 0;
+  for(int k=0;k<3;k++) {
+    e0[k] = clamp_byte((ax[k]*bb - bx[k]*ab) / det);
+    e1[k] = clamp_byte((bx[k]*aa - ax[k]*ab) / det);
+  }
+  return 1;
+}
+
+static void color_block_quality(const unsigned char block[64], unsigned char out[8]) {
+  float mean[3] = { 0, 0, 0 };
+  for(int i=0;i<16;i++)
+    for(int k=0;k<3;k++)
+      mean[k] += block[i*4 + k] / 16.0f;
+
+  float cov[6] = { 0, 0, 0, 0, 0, 0 };
+  for(int i=0;i<16;i++) {
+    float r = block[i*4] - mean[0], g = block[i*4 + 1] - mean[1], b = block[i*4 + 2] - mean[2];
+    cov[0] += r*r; cov[1] += r*g; cov[2] += r*b;
+    cov[3] += g*g; cov[4] += g*b; cov[5] += b*b;
+  }
+
+  // Power iteration for the principal axis, seeded with the box diagonal.
+  int lo[4], hi[4];
+  bounding_box(block, lo, hi);
+  float axis[3] = { (float)(hi[0] - lo[0]), (float)(hi[1] - lo[1]), (float)(hi[2] - lo[2]) };
+  for(int it=0;it<8;it++) {
+    float x = cov[0]*axis[0] + cov[1]*axis[1] + cov[2]*axis[2];
+    float y = cov[1]*axis[0] + cov[3]*axis[1] + cov[4]*axis[2];
+    float z = cov[2]*axis[0] + cov[4]*axis[1] + cov[5]*axis[2];
+    float len = fmaxf(fabsf(x), fmaxf(fabsf(y), fabsf(z)));
+    if(len < 1e-6f)
+      break;
+    axis[0] = x / len; axis[1] = y / len; axis[2] = z / len;
+  }
+  float len2 = axis[0]*axis[0] + axis[1]*axis[1] + axis[2]*axis[2];
+
+  int e0[3], e1[3];
+  if(len2 < 1e-6f) {
+    for(int k=0;k<3;k++)
+      e0[k] = e1[k] = clamp_byte(mean[k]);
+  } else {
+    float tmin = 1e30f, tmax = -1e30f;
+    for(int i=0;i<16;i++) {
+      float t = ((block[i*4] - mean[0])*axis[0] + (block[i*4 + 1] - mean[1])*axis[1] +
+                 (block[i*4 + 2] - mean[2])*axis[2]) / len2;
+      tmin = fminf(tmin, t);
+      tmax = fmaxf(tmax, t);
+    }
+    for(int k=0;k<3;k++) {
+      e0[k] = clamp_byte(mean[k] + axis[k]*tmax);
+      e1[k] = clamp_byte(mean[k] + axis[k]*tmin);
+    }
+  }
+
+  unsigned char best[8];
+  int best_error = emit_color_block(block, e0, e1, best);
+
+  unsigned char trial[8];
+  int error = emit_color_block(block, hi, lo, trial);
+  if(error < best_error) {
+    best_error = error;
+    memcpy(best, trial, 8);
+  }
+
+  for(int it=0;it<BC_REFINE_ITERATIONS;it++) {
+    unsigned int indices = best[4] | best[5] << 8 | best[6] << 16 | (unsigned int)best[7] << 24;
+    int c0 = best[0] | best[1] << 8, c1 = best[2] | best[3] << 8;
+    if(c0 == c1 || !refine_endpoints(block, indices, e0, e1))
+      break;
+    error = emit_color_block(block, e0, e1, trial);
+    if(error >= best_error)
+      break;
+    best_error = error;
+    memcpy(best, trial, 8);
+  }
+  memcpy(out, best, 8);
+}
+
+// Eight-value alpha block: a0 > a1, codes 2..7 interpolate from a0 to a1.
+static void alpha_block(const unsigned char block[64], unsigned char out[8], bc_mode mode) {
+  int lo = 255, hi = 0;
+  for(int i=0;i<16;i++) {
+    int a = block[i*4 + 3];
+    lo = a < lo ? a : lo;
+    hi = a > hi ? a : hi;
+  }
+  out[0] = hi;
+  out[1] = lo;
+
+  unsigned long long bits = 0;
+  if(hi != lo) {
+    int palette[8] = { hi, lo };
+    for(int c=2;c<8;c++)
+      palette[c] = ((8 - c)*hi + (c - 1)*lo + 3) / 7;
+
+    int range = hi - lo;
+    for(int i=0;i<16;i++) {
+      int a = block[i*4 + 3], code;
+      if(mode == BC_FAST) {
+        int pos = ((a - lo)*14 + range) / (2*range);
+        code = pos == 7 ? 0 : pos == 0 ? 1 : 8 - pos;
+      } else {
+        code = 0;
+        for(int c=1;c<8;c++)
+          if(abs(palette[c] - a) < abs(palette[code] - a))
+            code = c;
+      }
+      bits |= (unsigned long long)code << (3*i);
+    }
+  }
+  for(int k=0;k<6;k++)
+    out[2 + k] = bits >> (8*k) & 0xFF;
+}
+
+void encode_bc1_image(const unsigned char *pixels, int width, int height, int channels, unsigned char *out, bc_mode mode) {
+  alignas(16) unsigned char block[64];
+  for(int by=0;by<height;by+=4) {
+    for(int bx=0;bx<width;bx+=4) {
+      load_block(pixels, width, height, channels, bx, by, block);
+      if(mode == BC_FAST)
+        color_block_fast(block, out);
+      else
+        color_block_quality(block, out);
+      out += BC1_BLOCK_BYTES;
+    }
+  }
+}
+
+void encode_bc3_image(const unsigned char *pixels, int width, int height, int channels, unsigned char *out, bc_mode mode) {
+  alignas(16) unsigned char block[64];
+  for(int by=0;by<height;by+=4) {
+    for(int bx=0;bx<width;bx+=4) {
+      load_block(pixels, width, height, channels, bx, by, block);
+      alpha_block(block, out, mode);
+      if(mode == BC_FAST)
+        color_block_fast(block, out + 8);
+      else
+        color_block_quality(block, out + 8);
+      out += BC3_BLOCK_BYTES;
+    }
+  }
+}
@@ -0,0 +1,21 @@
+#ifndef BC_ENCODE_H
+#define BC_ENCODE_H
+
+#include <stddef.h>
+
+#define BC1_BLOCK_BYTES 8
+#define BC3_BLOCK_BYTES 16
+
+// BC_FAST fits each block's colour bounding box and is cheap enough to
+// run on canvas data every frame. BC_QUALITY fits the principal axis and
+// refines the endpoints by least squares; it is meant for offline assets.
+enum bc_mode {
+  BC_FAST,
+  BC_QUALITY
+};
+
+size_t bc_image_size(int width, int height, int block_bytes);
+void encode_bc1_image(const unsigned char *pixels, int width, int height, int channels, unsigned char *out, bc_mode mode);
+void encode_bc3_image(const unsigned char *pixels, int width, int height, int channels, unsigned char *out, bc_mode mode);
+
+#endif
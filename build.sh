@@ -1 +1,5 @@
-g++ -I ./includes/ -o main main.cpp glad.c stb_image.c -lGL -ldl -lglfw  
+g++ -I ./includes/ -o pack pack.cpp vfs.cpp
+./pack --cpp embedded_assets.cpp main.v.glsl main.f.glsl uniforms.glsl sprite.v.glsl sprite.f.glsl virtual.f.glsl virtual_texture.glsl container.jpg
+g++ -I ./includes/ -o main main.cpp frame_pacing.cpp shader.cpp shader_cache.cpp shader_reload.cpp shader_variant.cpp program_registry.cpp matrix.cpp uniform_ring.cpp gl_state.cpp sprite_batch.cpp mesh.cpp mesh_optimize.cpp vertex_format.cpp mesh_loader.cpp tracer.cpp texture_loader.cpp texture_file.cpp bc_encode.cpp texture_cache.cpp texture_atlas.cpp virtual_texture.cpp vfs.cpp embedded_assets.cpp glad.c stb_image.c image_arena.cpp -lGL -ldl -lglfw -pthread  
+g++ -I ./includes/ -o texconv texconv.cpp texture_file.cpp vfs.cpp bc_encode.cpp stb_image.c image_arena.cpp
+g++ -O2 -I ./includes/ -o batchconv batchconv.cpp texture_file.cpp vfs.cpp bc_encode.cpp stb_image.c image_arena.cpp -pthread
@@ -0,0 +1,11 @@
+#ifndef EMBEDDED_ASSETS_H
+#define EMBEDDED_ASSETS_H
+
+#include <stddef.h>
+
+// Pack image of the built-in shaders and default assets, generated into
+// embedded_assets.cpp by build.sh and mounted with vfs_mount_memory.
+extern const unsigned char embedded_pack[];
+extern const size_t embedded_pack_size;
+
+#endif
@@ -0,0 +1,126 @@
+#include "frame_pacing.h"
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+// Sleep granularity is coarse on most kernels, so stop sleeping this far
+// before the deadline and spin the rest of the way.
+#define PACER_SPIN_SECONDS 0.002
+
+// Intervals longer than this are idle gaps in on-demand mode, not frames.
+#define PACER_IDLE_GAP 0.25
+
+const char *pacing_mode_name(pacing_mode mode) {
+  switch(mode) {
+  case PACING_UNCAPPED: return "uncapped";
+  case PACING_VSYNC: return "vsync";
+  case PACING_TARGET_FPS: return "target fps";
+  }
+  return "unknown";
+}
+
+void pacer_init(frame_pacer *p, pacing_mode mode, double target_fps, int max_frames_in_flight) {
+  if(max_frames_in_flight > PACER_MAX_FRAMES_IN_FLIGHT)
+    max_frames_in_flight = PACER_MAX_FRAMES_IN_FLIGHT;
+  if(max_frames_in_flight < 0)
+    max_frames_in_flight = 0;
+
+  p->target_fps = target_fps > 0 ? target_fps : 60;
+  p->max_frames_in_flight = max_frames_in_flight;
+  for(int i=0;i<PACER_MAX_FRAMES_IN_FLIGHT;i++)
+    p->fences[i] = 0;
+  p->fence_index = 0;
+  p->deadline = 0;
+  p->last_present = 0;
+  p->samples = 0;
+  p->sum = p->sum_sq = p->worst = 0;
+
+  pacer_set_mode(p, mode);
+}
+
+void pacer_set_mode(frame_pacer *p, pacing_mode mode) {
+  p->mode = mode;
+  p->deadline = 0;
+  glfwSwapInterval(mode == PACING_VSYNC ? 1 : 0);
+}
+
+static void sleep_until(double when) {
+  double remaining = when - glfwGetTime();
+  if(remaining > PACER_SPIN_SECONDS) {
+    double s = remaining - PACER_SPIN_SECONDS;
+    struct timespec ts;
+    ts.tv_sec = (time_t)s;
+    ts.tv_nsec = (long)((s - ts.tv_sec) * 1e9);
+    nanosleep(&ts, NULL);
+  }
+  while(glfwGetTime() < when)
+    ;
+}
+
+void pacer_begin_frame(frame_pacer *p) {
+  // Block until the GPU has retired the frame submitted
+  // max_frames_in_flight presents ago, so the driver can't queue up
+  // frames of stale input ahead of the display.
+  if(p->max_frames_in_flight > 0) {
+    GLsync oldest = p->fences[p->fence_index];
+    if(oldest) {
+      glClientWaitSync(oldest, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+      glDeleteSync(oldest);
+      p->fences[p->fence_index] = 0;
+    }
+  }
+
+  if(p->mode == PACING_TARGET_FPS) {
+    double now = glfwGetTime();
+    double period = 1.0 / p->target_fps;
+    if(p->deadline == 0 || now - p->deadline > period)
+      p->deadline = now;
+    else
+      sleep_until(p->deadline);
+    p->deadline += period;
+  }
+}
+
+void pacer_end_frame(frame_pacer *p, GLFWwindow *window) {
+  glfwSwapBuffers(window);
+
+  if(p->max_frames_in_flight > 0) {
+    p->fences[p->fence_index] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    p->fence_index = (p->fence_index + 1) % p->max_frames_in_flight;
+  }
+
+  double now = glfwGetTime();
+  double dt = now - p->last_present;
+  if(p->last_present > 0 && dt < PACER_IDLE_GAP) {
+    p->samples++;
+    p->sum += dt;
+    p->sum_sq += dt*dt;
+    if(dt > p->worst)
+      p->worst = dt;
+  }
+  p->last_present = now;
+}
+
+void pacer_report(frame_pacer *p) {
+  if(p->samples < 2)
+    return;
+  double mean = p->sum / p->samples;
+  double variance = p->sum_sq / p->samples - mean*mean;
+  if(variance < 0)
+    variance = 0;
+
+  fprintf(stderr, "frames %d [%s]: mean %.3f ms (%.1f fps), stddev %.3f ms, variance %.4f ms^2, worst %.3f ms\n",
+          p->samples, pacing_mode_name(p->mode), mean*1000, 1.0/mean,
+          sqrt(variance)*1000, variance*1e6, p->worst*1000);
+
+  p->samples = 0;
+  p->sum = p->sum_sq = p->worst = 0;
+}
+
+void pacer_destroy(frame_pacer *p) {
+  for(int i=0;i<PACER_MAX_FRAMES_IN_FLIGHT;i++) {
+    if(p->fences[i])
+      glDeleteSync(p->fences[i]);
+    p->fences[i] = 0;
+  }
+}
@@ -0,0 +1,41 @@
+#ifndef FRAME_PACING_H
+#define FRAME_PACING_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#define PACER_MAX_FRAMES_IN_FLIGHT 4
+
+enum pacing_mode {
+  PACING_UNCAPPED,
+  PACING_VSYNC,
+  PACING_TARGET_FPS
+};
+
+// Frame limiter and swap-interval control. The limiter sleeps at the start
+// of the frame rather than after the swap, so input is sampled as late as
+// possible before rendering.
+struct frame_pacer {
+  pacing_mode mode;
+  double target_fps;
+  int max_frames_in_flight; // 0 disables the fence limit
+
+  GLsync fences[PACER_MAX_FRAMES_IN_FLIGHT];
+  int fence_index;
+
+  double deadline;
+  double last_present;
+
+  int samples;
+  double sum, sum_sq, worst;
+};
+
+void pacer_init(frame_pacer *p, pacing_mode mode, double target_fps, int max_frames_in_flight);
+void pacer_set_mode(frame_pacer *p, pacing_mode mode);
+void pacer_begin_frame(frame_pacer *p);
+void pacer_end_frame(frame_pacer *p, GLFWwindow *window);
+void pacer_report(frame_pacer *p);
+void pacer_destroy(frame_pacer *p);
+const char *pacing_mode_name(pacing_mode mode);
+
+#endif
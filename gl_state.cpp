@@ -0,0 +1,239 @@
+#include "gl_state.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Value no real binding can have, so the first call always goes through.
+#define STATE_UNKNOWN 0xFFFFFFFFu
+
+struct texture_params {
+  GLint wrap_s, wrap_t, min_filter, mag_filter;
+};
+
+struct buffer_range {
+  GLuint buffer;
+  GLintptr offset;
+  GLsizeiptr size;
+};
+
+static GLuint program = STATE_UNKNOWN;
+static GLuint vertex_array = STATE_UNKNOWN;
+static GLuint array_buffer = STATE_UNKNOWN;
+static GLuint uniform_buffer = STATE_UNKNOWN;
+static GLuint pixel_unpack_buffer = STATE_UNKNOWN;
+static int active_unit = -1;
+static GLuint textures[STATE_TEXTURE_UNITS];
+static GLenum texture_targets[STATE_TEXTURE_UNITS];
+static buffer_range uniform_ranges[STATE_UNIFORM_BINDINGS];
+
+// Per-texture sampling parameters, indexed by texture name. Names are
+// small consecutive integers in practice, so a flat array is enough.
+static texture_params *params;
+static GLuint params_capacity;
+
+static int blend = -1, depth_test = -1, cull_face = -1, scissor_test = -1;
+
+static gl_state_counters counters;
+static int initialized;
+
+static void init() {
+  if(initialized)
+    return;
+  initialized = 1;
+  for(int i=0;i<STATE_TEXTURE_UNITS;i++) {
+    textures[i] = STATE_UNKNOWN;
+    texture_targets[i] = 0;
+  }
+  for(int i=0;i<STATE_UNIFORM_BINDINGS;i++)
+    uniform_ranges[i].buffer = STATE_UNKNOWN;
+}
+
+static int changed(int differs) {
+  if(differs)
+    counters.issued++;
+  else
+    counters.skipped++;
+  return differs;
+}
+
+void state_use_program(GLuint p) {
+  if(changed(program != p)) {
+    glUseProgram(p);
+    program = p;
+  }
+}
+
+void state_bind_vertex_array(GLuint vao) {
+  if(changed(vertex_array != vao)) {
+    glBindVertexArray(vao);
+    vertex_array = vao;
+  }
+}
+
+static GLuint *buffer_slot(GLenum target) {
+  switch(target) {
+  case GL_ARRAY_BUFFER: return &array_buffer;
+  case GL_UNIFORM_BUFFER: return &uniform_buffer;
+  case GL_PIXEL_UNPACK_BUFFER: return &pixel_unpack_buffer;
+  }
+  // GL_ELEMENT_ARRAY_BUFFER is VAO state and anything else is rare
+  // enough to pass straight through.
+  return NULL;
+}
+
+void state_bind_buffer(GLenum target, GLuint buffer) {
+  GLuint *slot = buffer_slot(target);
+  if(!slot) {
+    counters.issued++;
+    glBindBuffer(target, buffer);
+    return;
+  }
+  if(changed(*slot != buffer)) {
+    glBindBuffer(target, buffer);
+    *slot = buffer;
+  }
+}
+
+void state_bind_buffer_range(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+  init();
+  if(target != GL_UNIFORM_BUFFER || index >= STATE_UNIFORM_BINDINGS) {
+    counters.issued++;
+    glBindBufferRange(target, index, buffer, offset, size);
+    return;
+  }
+  buffer_range *r = &uniform_ranges[index];
+  if(changed(r->buffer != buffer || r->offset != offset || r->size != size)) {
+    glBindBufferRange(target, index, buffer, offset, size);
+    r->buffer = buffer;
+    r->offset = offset;
+    r->size = size;
+    // Binding a range also changes the generic binding point.
+    uniform_buffer = buffer;
+  }
+}
+
+void state_bind_texture(int unit, GLenum target, GLuint texture) {
+  init();
+  if(unit < 0 || unit >= STATE_TEXTURE_UNITS) {
+    counters.issued += 2;
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(target, texture);
+    active_unit = -1;
+    return;
+  }
+  if(textures[unit] == texture && texture_targets[unit] == target) {
+    counters.skipped++;
+    return;
+  }
+  if(changed(active_unit != unit)) {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    active_unit = unit;
+  }
+  counters.issued++;
+  glBindTexture(target, texture);
+  textures[unit] = texture;
+  texture_targets[unit] = target;
+}
+
+static GLint *param_slot(GLuint texture, GLenum pname) {
+  if(texture == STATE_UNKNOWN)
+    return NULL;
+  if(texture >= params_capacity) {
+    GLuint capacity = params_capacity ? params_capacity : 64;
+    while(capacity <= texture)
+      capacity *= 2;
+    params = (texture_params *)realloc(params, capacity * sizeof(texture_params));
+    for(GLuint i=params_capacity;i<capacity;i++)
+      params[i].wrap_s = params[i].wrap_t = params[i].min_filter = params[i].mag_filter = -1;
+    params_capacity = capacity;
+  }
+  switch(pname) {
+  case GL_TEXTURE_WRAP_S: return &params[texture].wrap_s;
+  case GL_TEXTURE_WRAP_T: return &params[texture].wrap_t;
+  case GL_TEXTURE_MIN_FILTER: return &params[texture].min_filter;
+  case GL_TEXTURE_MAG_FILTER: return &params[texture].mag_filter;
+  }
+  return NULL;
+}
+
+// Applies to the texture bound on the active unit, like glTexParameteri.
+void state_tex_parameteri(GLenum target, GLenum pname, GLint value) {
+  GLuint texture = active_unit >= 0 ? textures[active_unit] : STATE_UNKNOWN;
+  GLint *slot = param_slot(texture, pname);
+  if(!slot) {
+    counters.issued++;
+    glTexParameteri(target, pname, value);
+    return;
+  }
+  if(changed(*slot != value)) {
+    glTexParameteri(target, pname, value);
+    *slot = value;
+  }
+}
+
+void state_enable(GLenum cap, int enabled) {
+  int *slot = NULL;
+  switch(cap) {
+  case GL_BLEND: slot = &blend; break;
+  case GL_DEPTH_TEST: slot = &depth_test; break;
+  case GL_CULL_FACE: slot = &cull_face; break;
+  case GL_SCISSOR_TEST: slot = &scissor_test; break;
+  }
+  enabled = enabled ? 1 : 0;
+  if(slot && !changed(*slot != enabled))
+    return;
+  if(!slot)
+    counters.issued++;
+  if(enabled)
+    glEnable(cap);
+  else
+    glDisable(cap);
+  if(slot)
+    *slot = enabled;
+}
+
+// Deleting a bound object reverts the binding to 0 in GL.
+void state_forget_program(GLuint p) {
+  if(program == p) program = STATE_UNKNOWN;
+}
+
+void state_forget_vertex_array(GLuint vao) {
+  if(vertex_array == vao) vertex_array = STATE_UNKNOWN;
+}
+
+void state_forget_buffer(GLuint buffer) {
+  if(array_buffer == buffer) array_buffer = STATE_UNKNOWN;
+  if(uniform_buffer == buffer) uniform_buffer = STATE_UNKNOWN;
+  if(pixel_unpack_buffer == buffer) pixel_unpack_buffer = STATE_UNKNOWN;
+  for(int i=0;i<STATE_UNIFORM_BINDINGS;i++)
+    if(uniform_ranges[i].buffer == buffer)
+      uniform_ranges[i].buffer = STATE_UNKNOWN;
+}
+
+void state_forget_texture(GLuint texture) {
+  init();
+  for(int i=0;i<STATE_TEXTURE_UNITS;i++)
+    if(textures[i] == texture)
+      textures[i] = STATE_UNKNOWN;
+  if(texture < params_capacity)
+    params[texture].wrap_s = params[texture].wrap_t = params[texture].min_filter = params[texture].mag_filter = -1;
+}
+
+void state_invalidate() {
+  initialized = 0;
+  init();
+  program = vertex_array = STATE_UNKNOWN;
+  array_buffer = uniform_buffer = pixel_unpack_buffer = STATE_UNKNOWN;
+  active_unit = -1;
+  blend = depth_test = cull_face = scissor_test = -1;
+  for(GLuint i=0;i<params_capacity;i++)
+    params[i].wrap_s = params[i].wrap_t = params[i].min_filter = params[i].mag_filter = -1;
+}
+
+gl_state_counters state_counters() {
+  return counters;
+}
+
+void state_reset_counters() {
+  counters.issued = 0;
+  counters.skipped = 0;
+}
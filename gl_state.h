@@ -0,0 +1,34 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+#define STATE_TEXTURE_UNITS 16
+#define STATE_UNIFORM_BINDINGS 16
+
+// Shadow of the GL binding state. Each state_* call compares against the
+// last value it set and skips the driver call when nothing changes. Code
+// that changes state behind the cache's back must call state_invalidate.
+struct gl_state_counters {
+  int issued;
+  int skipped;
+};
+
+void state_use_program(GLuint program);
+void state_bind_vertex_array(GLuint vao);
+void state_bind_buffer(GLenum target, GLuint buffer);
+void state_bind_buffer_range(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+void state_bind_texture(int unit, GLenum target, GLuint texture);
+void state_tex_parameteri(GLenum target, GLenum pname, GLint value);
+void state_enable(GLenum cap, int enabled);
+
+void state_forget_program(GLuint program);
+void state_forget_vertex_array(GLuint vao);
+void state_forget_buffer(GLuint buffer);
+void state_forget_texture(GLuint texture);
+void state_invalidate();
+
+gl_state_counters state_counters();
+void state_reset_counters();
+
+#endif
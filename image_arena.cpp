@@ -0,0 +1,186 @@
+#include "image_arena.h"
+#include "stb_image.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+
+// Every allocation carries this header so free and realloc can tell arena
+// memory from heap memory, and the pixels decode_image returns can be
+// released with stbi_image_free from any thread.
+#define ARENA_HEAP 0
+#define ARENA_BLOCK 1
+#define ARENA_ALIGN 16
+
+struct arena_header {
+  size_t size;
+  size_t kind;
+};
+
+struct image_arena {
+  unsigned char *block;
+  size_t capacity, used, peak, overflow;
+  size_t top;      // offset of the last allocation's header, for in-place growth
+  size_t output;   // size of the decoded image, which must outlive the arena
+  int active;
+};
+
+static thread_local image_arena arena;
+
+static std::atomic<size_t> total_decodes, total_capacity, total_overflow, max_peak;
+
+static size_t round_up(size_t n) {
+  return (n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static void *heap_alloc(size_t size) {
+  arena_header *h = (arena_header *)malloc(sizeof(arena_header) + size);
+  if(!h)
+    return NULL;
+  h->size = size;
+  h->kind = ARENA_HEAP;
+  return h + 1;
+}
+
+static void *block_alloc(size_t size) {
+  size_t need = sizeof(arena_header) + round_up(size);
+  if(arena.used + need > arena.capacity) {
+    arena.overflow += size;
+    return heap_alloc(size);
+  }
+  arena_header *h = (arena_header *)(arena.block + arena.used);
+  h->size = size;
+  h->kind = ARENA_BLOCK;
+  arena.top = arena.used;
+  arena.used += need;
+  if(arena.used > arena.peak)
+    arena.peak = arena.used;
+  return h + 1;
+}
+
+// The result stb hands back is one of the allocations of exactly the
+// image's size, so those go straight to the heap and need no copy later.
+void *image_arena_malloc(size_t size) {
+  return arena.active && size != arena.output ? block_alloc(size) : heap_alloc(size);
+}
+
+static int is_top(const arena_header *h) {
+  return h->kind == ARENA_BLOCK && (const unsigned char *)h == arena.block + arena.top && arena.used > arena.top;
+}
+
+void image_arena_free(void *p) {
+  if(!p)
+    return;
+  arena_header *h = (arena_header *)p - 1;
+  if(h->kind == ARENA_HEAP)
+    free(h);
+  else if(is_top(h))
+    arena.used = arena.top;
+  // Anything else in the block goes away at the next reset.
+}
+
+void *image_arena_realloc(void *p, size_t size) {
+  if(!p)
+    return image_arena_malloc(size);
+  arena_header *h = (arena_header *)p - 1;
+  // stb grows its output buffers by doubling; the last allocation can
+  // usually just extend.
+  if(is_top(h) && size != arena.output && arena.top + sizeof(arena_header) + round_up(size) <= arena.capacity) {
+    h->size = size;
+    arena.used = arena.top + sizeof(arena_header) + round_up(size);
+    if(arena.used > arena.peak)
+      arena.peak = arena.used;
+    return p;
+  }
+  if(h->kind == ARENA_HEAP && !arena.active) {
+    arena_header *n = (arena_header *)realloc(h, sizeof(arena_header) + size);
+    if(!n)
+      return NULL;
+    n->size = size;
+    return n + 1;
+  }
+  void *q = image_arena_malloc(size);
+  if(q) {
+    memcpy(q, p, h->size < size ? h->size : size);
+    image_arena_free(p);
+  }
+  return q;
+}
+
+static void update_max(std::atomic<size_t> &m, size_t v) {
+  size_t old = m.load();
+  while(v > old && !m.compare_exchange_weak(old, v)) {}
+}
+
+// Empties the arena. A decode that overflowed grows the block so the next
+// one of that size fits; the block is empty, so nothing is copied.
+static void reset_arena() {
+  update_max(max_peak, arena.peak);
+  total_overflow += arena.overflow;
+  size_t want = arena.peak + arena.overflow;
+  if(arena.overflow && want > arena.capacity) {
+    size_t capacity = arena.capacity ? arena.capacity : IMAGE_ARENA_INITIAL_BYTES;
+    while(capacity < want)
+      capacity *= 2;
+    free(arena.block);
+    arena.block = (unsigned char *)malloc(capacity);
+    total_capacity += capacity - arena.capacity;
+    arena.capacity = capacity;
+  }
+  arena.used = arena.top = arena.peak = arena.overflow = 0;
+}
+
+// stbi_load_from_memory with this thread's arena for scratch. The pixels
+// are on the heap; free them with stbi_image_free as usual.
+unsigned char *decode_image(const unsigned char *data, int size, int *width, int *height,
+                            int *channels, int desired_channels) {
+  if(!arena.block) {
+    arena.block = (unsigned char *)malloc(IMAGE_ARENA_INITIAL_BYTES);
+    arena.capacity = IMAGE_ARENA_INITIAL_BYTES;
+    total_capacity += arena.capacity;
+  }
+  // Probing the header allocates too; keep that in the arena.
+  int w, h, n;
+  arena.output = 0;
+  arena.active = 1;
+  if(stbi_info_from_memory(data, size, &w, &h, &n))
+    arena.output = (size_t)w * h * (desired_channels ? desired_channels : n);
+  unsigned char *pixels = stbi_load_from_memory(data, size, width, height, channels, desired_channels);
+  arena.active = 0;
+
+  // A format whose result was sized differently still gets a copy.
+  unsigned char *result = pixels;
+  if(pixels && ((arena_header *)pixels - 1)->kind == ARENA_BLOCK) {
+    size_t bytes = ((arena_header *)pixels - 1)->size;
+    result = (unsigned char *)heap_alloc(bytes);
+    if(result)
+      memcpy(result, pixels, bytes);
+  }
+  reset_arena();
+  total_decodes++;
+  return result;
+}
+
+// Gives this thread's block back to the heap; call before a decode
+// thread exits.
+void image_arena_release() {
+  total_capacity -= arena.capacity;
+  free(arena.block);
+  memset(&arena, 0, sizeof(arena));
+}
+
+image_arena_stats image_arena_totals() {
+  image_arena_stats s;
+  s.decodes = total_decodes;
+  s.peak_bytes = max_peak;
+  s.capacity_bytes = total_capacity;
+  s.overflow_bytes = total_overflow;
+  return s;
+}
+
+void image_arena_report() {
+  image_arena_stats s = image_arena_totals();
+  fprintf(stderr, "image arena: %zu decodes, peak %.1f MB per decode, %.1f MB held, %.1f MB overflowed to the heap\n",
+          s.decodes, s.peak_bytes / (1024.0 * 1024.0), s.capacity_bytes / (1024.0 * 1024.0),
+          s.overflow_bytes / (1024.0 * 1024.0));
+}
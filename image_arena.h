@@ -0,0 +1,31 @@
+#ifndef IMAGE_ARENA_H
+#define IMAGE_ARENA_H
+
+#include <stddef.h>
+
+// Scratch allocator behind STBI_MALLOC/STBI_REALLOC/STBI_FREE (see
+// stb_image.c). Inside decode_image each thread bump-allocates from its
+// own block, which is reset after every image and grown to the largest
+// decode it has seen, so a worker decoding image after image stops
+// touching the heap. Outside decode_image stb allocates from the heap as
+// usual.
+#define IMAGE_ARENA_INITIAL_BYTES (4 << 20)
+
+struct image_arena_stats {
+  size_t decodes;
+  size_t peak_bytes;       // most arena memory one decode used
+  size_t capacity_bytes;   // arena blocks held by all threads
+  size_t overflow_bytes;   // scratch that missed the arena and went to the heap
+};
+
+void *image_arena_malloc(size_t size);
+void *image_arena_realloc(void *p, size_t size);
+void image_arena_free(void *p);
+
+unsigned char *decode_image(const unsigned char *data, int size, int *width, int *height,
+                            int *channels, int desired_channels);
+void image_arena_release();
+image_arena_stats image_arena_totals();
+void image_arena_report();
+
+#endif
@@ -4,13 +4,29 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include "stb_image.h"
+#include "frame_pacing.h"
+#include "shader.h"
+#include "shader_reload.h"
+#include "program_registry.h"
+#include "matrix.h"
+#include "uniform_ring.h"
+#include "uniform_blocks.h"
+#include "gl_state.h"
+#include "sprite_batch.h"
+#include "mesh.h"
+#include "mesh_loader.h"
+#include "tracer.h"
+#include "texture_loader.h"
+#include "bc_encode.h"
+#include "texture_cache.h"
+#include "texture_atlas.h"
+#include "virtual_texture.h"
+#include "vfs.h"
+#include "embedded_assets.h"
+#include "image_arena.h"
 #include <math.h>
-
-struct mesh {
-  GLuint VAO;
-  GLuint vertex_buffer;
-  GLuint shader_program;
-};
+#include <float.h>
+#include <unistd.h>
 
 struct canvas {
   unsigned char *data;
@@ -41,14 +57,31 @@ struct light {
   vector3 color, position;
 };
 
+// Drives when the loop presents. In on-demand mode the loop sleeps in
+// glfwWaitEvents until input, a resize or a redraw request marks it dirty.
+struct present_state {
+  int continuous;
+  int dirty;
+  double wake_at;
+  frame_pacer *pacer;
+  int sprite_test;
+  int show_image;
+};
+
 void processInput(GLFWwindow *window);
-GLuint getShaderProgram(const char *vertexFile, const char *fragmentFile);
-GLuint make_shader(GLenum type, const char *filename);
-GLuint make_program(GLuint vertex_shader, GLuint fragment_shader);
-void show_info_log(GLuint object);
-void *file_contents(const char *filename, GLint *length);
-mesh make_mesh(float *vertices, int size, const char *vertexFile, const char *fragmentFile);
+void drawSpriteTest(sprite_batch *batch, GLuint program, GLuint texture, float time);
+void makeIcon(unsigned char *rgba, int w, int h, int seed);
+void drawAtlasTest(sprite_batch *batch, GLuint program, const atlas_rect *icons, int count, float time);
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);  
+void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods);
+void cursor_callback(GLFWwindow *window, double x, double y);
+void mouse_button_callback(GLFWwindow *window, int button, int action, int mods);
+void scroll_callback(GLFWwindow *window, double dx, double dy);
+void refresh_callback(GLFWwindow *window);
+
+void request_redraw(present_state *p);
+void schedule_redraw(present_state *p, double at);
+void wait_for_frame(present_state *p);
 
 void putpixel(canvas c, int x, int y, int r, int g, int b);
 
@@ -83,7 +116,14 @@ int main(int argc, char **argv)
       glfwTerminate();
       return -1;
     }
+  present_state present = { 0, 1, 0, NULL, 0, 0 };
+  glfwSetWindowUserPointer(window, &present);
   glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+  glfwSetKeyCallback(window, key_callback);
+  glfwSetCursorPosCallback(window, cursor_callback);
+  glfwSetMouseButtonCallback(window, mouse_button_callback);
+  glfwSetScrollCallback(window, scroll_callback);
+  glfwSetWindowRefreshCallback(window, refresh_callback);
   glfwMakeContextCurrent(window);
 
   if(!gladLoadGLLoader((GLADloadproc)(glfwGetProcAddress)))
@@ -92,35 +132,118 @@ int main(int argc, char **argv)
     }
   
   glViewport(0, 0, 800, 600);
+
+  // Shaders and assets come from assets.pak when there is one (see
+  // pack.cpp), then from the copies build.sh compiled in, then from loose
+  // files in the working directory. Startup reads no files for built-ins.
+  if(access("assets.pak", R_OK) == 0)
+    vfs_mount("assets.pak");
+  vfs_mount_memory("built-in", embedded_pack, embedded_pack_size);
+
+  frame_pacer pacer;
+  pacer_init(&pacer, PACING_VSYNC, 60, 2);
+  present.pacer = &pacer;
   
   float vertices[] = {
                       -1.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f,
                       1.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f,
                       -1.0f,  1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f,
-                      -1.0f,  1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f,
+                      -1.0f,  1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f,
                       1.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f,
                       1.0f,  1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f                    
   };
   
-  mesh triangle = make_mesh(vertices, sizeof(vertices)/sizeof(float), argv[1], "main.f.glsl");  
-  glBindVertexArray(triangle.VAO);
-  glUseProgram(triangle.shader_program);
+  const char *vertexFile = argc > 1 ? argv[1] : "main.v.glsl";
+  mesh triangle = make_mesh(vertices, sizeof(vertices)/sizeof(float), vertexFile, "main.f.glsl");  
+
+  // Optional model: ./main [vertex shader] [model.obj|model.ply]
+  mesh model = {};
+  triangle_list modelTriangles = {};
+  mat4 modelFit = mat4_identity();
+  mesh_data modelData;
+  int hasModel = argc > 2 && load_mesh_file(argv[2], &modelData);
+  if(hasModel) {
+    model = mesh_from_data(&modelData, vertexFile, "main.f.glsl");
+    mesh_data_triangles(&modelData, &modelTriangles);
+
+    float lo[3], hi[3];
+    mesh_data_bounds(&modelData, lo, hi);
+    float extent = fmaxf(hi[0] - lo[0], fmaxf(hi[1] - lo[1], hi[2] - lo[2]));
+    float fit = extent > 0 ? 1.8f / extent : 1;
+    modelFit = mat4_multiply(mat4_scale(fit, fit, fit),
+                             mat4_translate(-(lo[0] + hi[0])/2, -(lo[1] + hi[1])/2, -(lo[2] + hi[2])/2));
+    free_mesh_data(&modelData);
+  }
+  tri_accel modelAccel = {};
+  if(hasModel && build_tri_accel(&modelAccel, &modelTriangles, modelFit)) {
+    fprintf(stderr, "%s: %d triangles, %d BVH nodes, %d packs\n", argv[2],
+            modelAccel.triangle_count, modelAccel.node_count, modelAccel.pack_count);
+    benchmark_triangle_tests(&modelAccel, 256);
+  }
+  state_bind_vertex_array(triangle.VAO);
+  state_use_program(triangle.shader_program);
+
+  uniform_ring uniforms;
+  uniform_ring_init(&uniforms, 64*1024, 3);
+  transform2d quad = { 0, 0, 0, 0, 1, 1 };
+
+  sprite_batch sprites;
+  sprite_batch_init(&sprites, 16384);
+  int spriteProgram = acquire_program("sprite.v.glsl", "sprite.f.glsl", NULL);
 
-  GLuint timer = glGetUniformLocation(triangle.shader_program, "timer");
+  shader_reloader reloader;
+  shader_reload_start(&reloader, vertexFile, "main.f.glsl");
   
+  texture_loader textures;
+  texture_loader_init(&textures, 0);
+  textures.bgra = 1;
+
+  texture_cache images;
+  texture_cache_init(&images, &textures, 64 << 20);
+
+  // Shown on the quad with T. A texconv bake (./texconv container.jpg
+  // container.tex) maps and uploads with no decode; otherwise the jpg is
+  // decoded off-thread. Asking now starts the load during the trace.
+  const char *imagePath = vfs_exists("container.tex") ? "container.tex" : "container.jpg";
+  texture_cache_get(&images, imagePath, 0);
+
+  // Third T mode: the same image streamed as a virtual texture from
+  // texconv --virtual container.jpg container.vtex, a page at a time.
+  virtual_texture vt;
+  int hasVirtual = vt_open(&vt, "container.vtex", 16);
+  const char *virtualVariants[2] = { NULL, "FEEDBACK" };
+  int virtualSlots[2] = { -1, -1 };
+  if(hasVirtual)
+    precompile_programs(vertexFile, "virtual.f.glsl", virtualVariants, 2, virtualSlots);
+  int virtualProgram = virtualSlots[0], feedbackProgram = virtualSlots[1];
+
+  // Thousands of small procedural icons packed for the second sprite test.
+  const int iconCount = 2000;
+  texture_atlas atlas;
+  atlas_init(&atlas, 2048, 2);
+  atlas_rect *icons = (atlas_rect *)malloc(iconCount * sizeof(atlas_rect));
+  unsigned char *iconPixels = (unsigned char *)malloc(32*32*4);
+  for(int i=0;i<iconCount;i++) {
+    int w = 8 + (i*7919) % 25, h = 8 + (i*104729) % 25;
+    makeIcon(iconPixels, w, h, i);
+    atlas_add(&atlas, iconPixels, w, h, &icons[i]);
+  }
+  free(iconPixels);
+  atlas_report(&atlas);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
   unsigned int texture;  
   glGenTextures(1, &texture);
-  glBindTexture(GL_TEXTURE_2D, texture);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  state_bind_texture(0, GL_TEXTURE_2D, texture);
+  state_tex_parameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	
+  state_tex_parameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  state_tex_parameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  state_tex_parameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
   canvas screen = newcanvas(2000, 2000);     
   float startTime = glfwGetTime();
   float elapsedTime = 0;
   float totalElapsed = 0;
-  float ems = 0;
 
   vector3 ray = { 0, 0, -5 };
   vector3 origin = { 0, 0, 0 };
@@ -145,6 +268,20 @@ int main(int argc, char **argv)
     for(int x=0;x<screen.width;x++) {
       vector3 sp = { -3.5 + x*(7.0f/screen.width), -3.0 + y*(7.0f/screen.height), 5.0f };  
       vector3 dir = sp - ray;
+
+      if(hasModel) {
+        float org[3] = { ray.x, ray.y, ray.z }, d[3] = { dir.x, dir.y, dir.z };
+        tri_hit hit;
+        if(intersect_tri_accel(&modelAccel, org, d, FLT_MAX, &hit)) {
+          vector3 p = ray + hit.t*dir;
+          vector3 n = normalize({ hit.normal[0], hit.normal[1], hit.normal[2] });
+          if(dot(n, dir) > 0)
+            n = -n;
+          vector3 color = (255/(m.specular+m.diffuse+m.ambient))*lighting(m, l, p, normalize(ray), n);
+          putpixel(screen, x, y, color.x, color.y, color.z);
+        }
+        continue;
+      }
       
       float a = dot(dir, dir);
       float b = 2*dot(ray, dir);
@@ -165,9 +302,42 @@ int main(int argc, char **argv)
   }
 
   updateCanvas(screen);  
+  request_redraw(&present);
+  double clockStart = glfwGetTime();
+  int frame = 0;
+  int stateFrames = 0;
   
   while(!glfwWindowShouldClose(window))
     {
+      wait_for_frame(&present);
+
+      GLuint relinked = 0;
+      if(shader_reload_poll(&reloader, &relinked)) {
+        registry_replace_program(triangle.program_slot, relinked);
+        triangle.shader_program = relinked;
+        state_use_program(triangle.shader_program);
+        request_redraw(&present);
+      } else if(reloader.pending_program) {
+        // Keep waking up until the background link completes.
+        schedule_redraw(&present, glfwGetTime() + 0.01);
+      }
+
+      if(texture_loader_poll(&textures, 1) || textures.upload_backlog)
+        request_redraw(&present);
+
+      if(hasVirtual) {
+        if(vt_update(&vt))
+          request_redraw(&present);
+        else if(vt.readback_fence)
+          schedule_redraw(&present, glfwGetTime() + 0.01);
+      }
+
+      if(!present.dirty)
+        continue;
+      present.dirty = 0;
+
+      collect_programs(frame++);
+      pacer_begin_frame(&pacer);
       startTime = glfwGetTime();
       
       processInput(window);      
@@ -176,21 +346,142 @@ int main(int argc, char **argv)
 
       //generateStatic(screen);
 
+      int fbWidth, fbHeight;
+      glfwGetFramebufferSize(window, &fbWidth, &fbHeight);
+
+      // Wall-clock time, so animation stays correct across idle waits.
+      totalElapsed = glfwGetTime() - clockStart;
+
+      // Gather every block for the frame first, upload once, then draw.
+      uniform_ring_begin_frame(&uniforms);
+
+      frame_block frameData = {};
+      frameData.time = totalElapsed;
+      frameData.delta = elapsedTime;
+      frameData.light_position[0] = l.position.x;
+      frameData.light_position[1] = l.position.y;
+      frameData.light_position[2] = l.position.z;
+      frameData.light_position[3] = 1;
+      frameData.light_color[0] = l.color.x;
+      frameData.light_color[1] = l.color.y;
+      frameData.light_color[2] = l.color.z;
+      frameData.light_color[3] = 1;
+      GLintptr frameOffset = uniform_ring_push(&uniforms, &frameData, sizeof(frameData));
+
+      view_block viewData = {};
+      viewData.view = mat4_ortho_aspect(fbWidth, fbHeight);
+      viewData.eye[0] = ray.x;
+      viewData.eye[1] = ray.y;
+      viewData.eye[2] = ray.z;
+      viewData.eye[3] = 1;
+      viewData.viewport[0] = fbWidth;
+      viewData.viewport[1] = fbHeight;
+      GLintptr viewOffset = uniform_ring_push(&uniforms, &viewData, sizeof(viewData));
+
+      material_block materialData = {};
+      materialData.color[0] = m.color.x;
+      materialData.color[1] = m.color.y;
+      materialData.color[2] = m.color.z;
+      materialData.color[3] = 1;
+      materialData.ambient = m.ambient;
+      materialData.diffuse = m.diffuse;
+      materialData.specular = m.specular;
+      materialData.shininess = m.shininess;
+      GLintptr materialOffset = uniform_ring_push(&uniforms, &materialData, sizeof(materialData));
+
+      object_block quadData;
+      quadData.transform = mat4_multiply(mat4_multiply(viewData.view, transform_matrix(quad)), triangle.local);
+      GLintptr quadOffset = uniform_ring_push(&uniforms, &quadData, sizeof(quadData));
+
+      GLintptr modelOffset = -1;
+      if(hasModel) {
+        object_block modelBlock;
+        modelBlock.transform = mat4_multiply(mat4_multiply(viewData.view, modelFit), model.local);
+        modelOffset = uniform_ring_push(&uniforms, &modelBlock, sizeof(modelBlock));
+      }
+
+      uniform_ring_upload(&uniforms);
+      uniform_ring_bind(&uniforms, FRAME_BLOCK_BINDING, frameOffset, sizeof(frame_block));
+      uniform_ring_bind(&uniforms, VIEW_BLOCK_BINDING, viewOffset, sizeof(view_block));
+      uniform_ring_bind(&uniforms, MATERIAL_BLOCK_BINDING, materialOffset, sizeof(material_block));
+      uniform_ring_bind(&uniforms, OBJECT_BLOCK_BINDING, quadOffset, sizeof(object_block));
+
+
+      if(present.show_image == 2 && hasVirtual && virtualProgram >= 0 && feedbackProgram >= 0) {
+        if(vt_begin_feedback(&vt, fbWidth, fbHeight)) {
+          vt_bind(&vt, registry_program(feedbackProgram), 1, 2, 1);
+          draw_mesh_program(&triangle, registry_program(feedbackProgram));
+          vt_end_feedback(&vt, fbWidth, fbHeight);
+        }
+        vt_bind(&vt, registry_program(virtualProgram), 1, 2, 0);
+        draw_mesh_program(&triangle, registry_program(virtualProgram));
+      } else {
+        state_bind_texture(0, GL_TEXTURE_2D, present.show_image ? texture_cache_get(&images, imagePath, 0) : texture);
+        draw_mesh(&triangle);
+      }
+
+      if(hasModel) {
+        uniform_ring_bind(&uniforms, OBJECT_BLOCK_BINDING, modelOffset, sizeof(object_block));
+        draw_mesh(&model);
+      }
 
-      glDrawArrays(GL_TRIANGLES, 0, 6);
+      if(present.sprite_test && spriteProgram >= 0) {
+        // Icons have transparent corners; the canvas tiles are opaque.
+        state_enable(GL_BLEND, present.sprite_test == 2);
+        sprite_batch_begin(&sprites);
+        if(present.sprite_test == 1)
+          drawSpriteTest(&sprites, registry_program(spriteProgram), texture, totalElapsed);
+        else
+          drawAtlasTest(&sprites, registry_program(spriteProgram), icons, iconCount, totalElapsed);
+        sprite_batch_end(&sprites);
+        state_enable(GL_BLEND, 0);
+      }
+      uniform_ring_end_frame(&uniforms);
+      texture_cache_end_frame(&images);
     
-      glfwSwapBuffers(window);      
-      glfwPollEvents();     
+      pacer_end_frame(&pacer, window);
 
       elapsedTime = glfwGetTime() - startTime;
 
-      ems = elapsedTime;
-      std::cout<<ems<<std::endl;
+      stateFrames++;
+      if(pacer.samples >= 240) {
+        pacer_report(&pacer);
+        gl_state_counters calls = state_counters();
+        fprintf(stderr, "gl state: %.1f calls issued, %.1f skipped per frame\n",
+                (float)calls.issued / stateFrames, (float)calls.skipped / stateFrames);
+        state_reset_counters();
+        stateFrames = 0;
+        texture_cache_report(&images);
+        if(hasVirtual)
+          vt_report(&vt);
+      }
       
-      totalElapsed += elapsedTime;      
-      glUniform1f(timer, totalElapsed);      
     }
 
+  shader_reload_stop(&reloader);
+  sprite_batch_destroy(&sprites);
+  release_program(spriteProgram);
+  uniform_ring_destroy(&uniforms);
+  destroy_mesh(&triangle);
+  texture_cache_destroy(&images);
+  if(hasVirtual) {
+    release_program(virtualProgram);
+    release_program(feedbackProgram);
+    vt_close(&vt);
+  }
+  atlas_destroy(&atlas);
+  free(icons);
+  texture_loader_destroy(&textures);
+  image_arena_report();
+  if(hasModel) {
+    destroy_mesh(&model);
+    free_triangle_list(&modelTriangles);
+    free_tri_accel(&modelAccel);
+  }
+  destroy_program_registry();
+  pacer_report(&pacer);
+  pacer_destroy(&pacer);
+  vfs_unmount_all();
   glfwTerminate();
   return 0;
 }
@@ -202,114 +493,144 @@ void processInput(GLFWwindow *window)
   }
 }
 
-GLuint getShaderProgram(const char *vertexFile, const char *fragmentFile)
+// A 100x100 grid of tiles cut from the canvas, bobbing over time.
+void drawSpriteTest(sprite_batch *batch, GLuint program, GLuint texture, float time)
 {
-  GLuint vertexShader = make_shader(GL_VERTEX_SHADER, vertexFile);
-  GLuint fragmentShader = make_shader(GL_FRAGMENT_SHADER, fragmentFile);
-  GLuint shaderProgram = make_program(vertexShader, fragmentShader);
-  
-  return shaderProgram;
+  const int n = 100;
+  float size = 2.0f / n;
+  for(int y=0;y<n;y++) {
+    for(int x=0;x<n;x++) {
+      sprite_instance s;
+      s.x = -1 + x*size + 0.25f*size*sinf(time + y*0.3f);
+      s.y = -1 + y*size + 0.25f*size*cosf(time + x*0.3f);
+      s.w = s.h = size*0.9f;
+      s.u0 = (float)x / n;
+      s.v0 = (float)y / n;
+      s.u1 = (float)(x+1) / n;
+      s.v1 = (float)(y+1) / n;
+      s.r = x*255/n;
+      s.g = y*255/n;
+      s.b = 255;
+      s.a = 255;
+      sprite_batch_draw(batch, program, texture, s);
+    }
+  }
 }
 
-GLuint make_shader(GLenum type, const char *filename)
+// A filled disc with a ring, in a colour picked from the seed.
+void makeIcon(unsigned char *rgba, int w, int h, int seed)
 {
-  GLint length;
-  GLchar *source = (GLchar *)file_contents(filename, &length);
-  GLuint shader;
-  GLint shader_ok;
-
-  if(!source) return 0;
-  shader = glCreateShader(type);
-  glShaderSource(shader, 1, (const GLchar**)&source, &length);
-  free(source);
-  glCompileShader(shader);
-
-  glGetShaderiv(shader, GL_COMPILE_STATUS, &shader_ok);
-  if(!shader_ok) {
-    fprintf(stderr, "Failed to compile %s: \n", filename);
-    show_info_log(shader);
-    glDeleteShader(shader);
-    return 0;
+  unsigned char r = 64 + (seed*37) % 192, g = 64 + (seed*91) % 192, b = 64 + (seed*53) % 192;
+  float cx = (w - 1) / 2.0f, cy = (h - 1) / 2.0f, radius = fminf(cx, cy);
+  for(int y=0;y<h;y++) {
+    for(int x=0;x<w;x++) {
+      float d = sqrtf((x - cx)*(x - cx) + (y - cy)*(y - cy)) / (radius + 0.5f);
+      unsigned char *p = rgba + (y*w + x)*4;
+      int ring = d > 0.7f && d < 0.85f;
+      p[0] = ring ? 255 : r;
+      p[1] = ring ? 255 : g;
+      p[2] = ring ? 255 : b;
+      p[3] = d <= 1 ? 255 : 0;
+    }
   }
-  return shader;
 }
 
-void show_info_log(GLuint object)
+// Every icon drifting across the window; all on one atlas page, so the
+// sprite batch draws them with one bind and one instanced draw.
+void drawAtlasTest(sprite_batch *batch, GLuint program, const atlas_rect *icons, int count, float time)
 {
-  GLint log_length;
-  char *log;
-
-  glGetShaderiv(object, GL_INFO_LOG_LENGTH, &log_length);
-  log = (char*)malloc(log_length);
-  glGetShaderInfoLog(object, log_length, NULL, log);
-  fprintf(stderr, "%s", log);
-  free(log); 
+  int columns = 50, rows = (count + columns - 1) / columns;
+  for(int i=0;i<count;i++) {
+    const atlas_rect *icon = &icons[i];
+    sprite_instance s;
+    s.x = -1 + (i % columns) * (2.0f / columns) + 0.02f*sinf(time + i);
+    s.y = -1 + (i / columns) * (2.0f / rows);
+    s.w = icon->w / 400.0f;
+    s.h = icon->h / 400.0f;
+    s.u0 = icon->u0;
+    s.v0 = icon->v0;
+    s.u1 = icon->u1;
+    s.v1 = icon->v1;
+    s.r = s.g = s.b = s.a = 255;
+    sprite_batch_draw(batch, program, icon->texture, s);
+  }
 }
 
-GLuint make_program(GLuint vertex_shader, GLuint fragment_shader)
-{
-  GLint program_ok;
-  GLuint program = glCreateProgram();
-
-  glAttachShader(program, vertex_shader);
-  glAttachShader(program, fragment_shader);
-  glLinkProgram(program);
+void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
+  glViewport(0, 0, width, height);
+  request_redraw((present_state *)glfwGetWindowUserPointer(window));
+}
 
-  return program;
+void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods) {
+  present_state *p = (present_state *)glfwGetWindowUserPointer(window);
+  if(key == GLFW_KEY_C && action == GLFW_PRESS) {
+    p->continuous = !p->continuous;
+    fprintf(stderr, "present mode: %s\n", p->continuous ? "continuous" : "on demand");
+  }
+  if(key == GLFW_KEY_S && action == GLFW_PRESS)
+    p->sprite_test = (p->sprite_test + 1) % 3;
+  if(key == GLFW_KEY_T && action == GLFW_PRESS)
+    p->show_image = (p->show_image + 1) % 3;
+  if(key == GLFW_KEY_V && action == GLFW_PRESS && p->pacer) {
+    pacer_report(p->pacer);
+    pacer_set_mode(p->pacer, (pacing_mode)((p->pacer->mode + 1) % 3));
+    fprintf(stderr, "pacing: %s\n", pacing_mode_name(p->pacer->mode));
+  }
+  request_redraw(p);
 }
 
-void *file_contents(const char *filename, GLint *length) {
-  FILE *f = fopen(filename, "r");
-  void *buffer;
+void cursor_callback(GLFWwindow *window, double x, double y) {
+  request_redraw((present_state *)glfwGetWindowUserPointer(window));
+}
 
-  if(!f) {
-    fprintf(stderr, "Unable to open %s ofr reading\n", filename);
-    return NULL;    
-  }
+void mouse_button_callback(GLFWwindow *window, int button, int action, int mods) {
+  request_redraw((present_state *)glfwGetWindowUserPointer(window));
+}
 
-  fseek(f, 0, SEEK_END);
-  *length = ftell(f);
-  fseek(f, 0, SEEK_SET);
+void scroll_callback(GLFWwindow *window, double dx, double dy) {
+  request_redraw((present_state *)glfwGetWindowUserPointer(window));
+}
 
-  buffer = malloc(*length + 1);
-  *length = fread(buffer, 1, *length, f);
-  fclose(f);
-  ((char *)buffer)[*length]= '\0';
+void refresh_callback(GLFWwindow *window) {
+  request_redraw((present_state *)glfwGetWindowUserPointer(window));
+}
 
-  return buffer;
+void request_redraw(present_state *p) {
+  p->dirty = 1;
 }
 
-mesh make_mesh(float *vertices, int size, const char *vertexFile, const char *fragmentFile)
-{
-  unsigned int VAO;
-  glGenVertexArrays(1, &VAO);
-  glBindVertexArray(VAO);
-  
-  unsigned int VBO;
-  glGenBuffers(1, &VBO);
-  glBindBuffer(GL_ARRAY_BUFFER, VBO);
-  glBufferData(GL_ARRAY_BUFFER, size*sizeof(float), vertices, GL_STATIC_DRAW);
-  
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)0);
-  glEnableVertexAttribArray(0);
-  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)(3*sizeof(float)));
-  glEnableVertexAttribArray(1);
-  glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)(6*sizeof(float)));
-  glEnableVertexAttribArray(2);
-
-  unsigned int shaderProgram;
-  shaderProgram = getShaderProgram("main.v.glsl", "main.f.glsl");
-
-  glBindVertexArray(0);
-
-  mesh m;
-  m.VAO = VAO;
-  m.shader_program = shaderProgram;
-  return m;
+// Animation clock hook: ask for a frame at absolute glfwGetTime() 'at'.
+// The earliest pending deadline wins.
+void schedule_redraw(present_state *p, double at) {
+  if(p->wake_at == 0 || at < p->wake_at)
+    p->wake_at = at;
 }
 
-void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
-  glViewport(0, 0, width, height);
+void wait_for_frame(present_state *p) {
+  if(p->continuous) {
+    glfwPollEvents();
+    p->dirty = 1;
+    return;
+  }
+
+  if(!p->dirty) {
+    if(p->wake_at > 0) {
+      double timeout = p->wake_at - glfwGetTime();
+      if(timeout > 0)
+        glfwWaitEventsTimeout(timeout);
+      else
+        glfwPollEvents();
+    } else {
+      glfwWaitEvents();
+    }
+  } else {
+    glfwPollEvents();
+  }
+
+  if(p->wake_at > 0 && glfwGetTime() >= p->wake_at) {
+    p->wake_at = 0;
+    p->dirty = 1;
+  }
 }
 
 canvas newcanvas(int w, int h) {
@@ -352,7 +673,32 @@ void generateStatic(canvas screen) {
   glGenerateMipmap(GL_TEXTURE_2D);
 }
 
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+
+// With S3TC the canvas goes up as fast-mode BC1: 2 MB a frame for the
+// 2000x2000 canvas instead of 12 MB of RGB. The canvas texture samples
+// with GL_LINEAR, so the compressed path needs no mipmaps.
 void updateCanvas(canvas screen) {
+  static int s3tc = -1;
+  static int allocatedWidth = 0, allocatedHeight = 0;
+  if(s3tc < 0)
+    s3tc = glfwExtensionSupported("GL_EXT_texture_compression_s3tc");
+
+  if(s3tc) {
+    GLsizei size = bc_image_size(screen.width, screen.height, BC1_BLOCK_BYTES);
+    unsigned char *blocks = (unsigned char *)malloc(size);
+    encode_bc1_image(screen.data, screen.width, screen.height, 3, blocks, BC_FAST);
+    if(allocatedWidth != screen.width || allocatedHeight != screen.height) {
+      glCompressedTexImage2D(GL_TEXTURE_2D, 0, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, screen.width, screen.height, 0, size, blocks);
+      allocatedWidth = screen.width;
+      allocatedHeight = screen.height;
+    } else {
+      glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, screen.width, screen.height, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, size, blocks);
+    }
+    free(blocks);
+    return;
+  }
+
   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, screen.width, screen.height, 0, GL_RGB, GL_UNSIGNED_BYTE, screen.data);  
   glGenerateMipmap(GL_TEXTURE_2D);
 }
@@ -9,4 +9,7 @@ uniform sampler2D ourTexture;
 void main()
 {
 FragColor = texture(ourTexture, vec2(texCoord.x, -texCoord.y));
+#ifdef VERTEX_COLOR
+FragColor *= vertexColor;
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,159 @@
+#include "matrix.h"
+#include <math.h>
+#include <string.h>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+mat4 mat4_identity() {
+  mat4 r;
+  memset(&r, 0, sizeof(r));
+  r.m[0] = r.m[5] = r.m[10] = r.m[15] = 1.0f;
+  return r;
+}
+
+// r.col[j] = sum_k a.col[k] * b[j][k]: four broadcasts and four
+// multiply-adds per column.
+mat4 mat4_multiply(const mat4 &a, const mat4 &b) {
+  mat4 r;
+#ifdef __SSE__
+  __m128 a0 = _mm_load_ps(a.m + 0);
+  __m128 a1 = _mm_load_ps(a.m + 4);
+  __m128 a2 = _mm_load_ps(a.m + 8);
+  __m128 a3 = _mm_load_ps(a.m + 12);
+  for(int j=0;j<4;j++) {
+    const float *bc = b.m + j*4;
+    __m128 c = _mm_mul_ps(a0, _mm_set1_ps(bc[0]));
+    c = _mm_add_ps(c, _mm_mul_ps(a1, _mm_set1_ps(bc[1])));
+    c = _mm_add_ps(c, _mm_mul_ps(a2, _mm_set1_ps(bc[2])));
+    c = _mm_add_ps(c, _mm_mul_ps(a3, _mm_set1_ps(bc[3])));
+    _mm_store_ps(r.m + j*4, c);
+  }
+#else
+  for(int j=0;j<4;j++)
+    for(int i=0;i<4;i++)
+      r.m[j*4+i] = a.m[i]*b.m[j*4] + a.m[4+i]*b.m[j*4+1] + a.m[8+i]*b.m[j*4+2] + a.m[12+i]*b.m[j*4+3];
+#endif
+  return r;
+}
+
+mat4 mat4_translate(float x, float y, float z) {
+  mat4 r = mat4_identity();
+  r.m[12] = x;
+  r.m[13] = y;
+  r.m[14] = z;
+  return r;
+}
+
+mat4 mat4_scale(float x, float y, float z) {
+  mat4 r = mat4_identity();
+  r.m[0] = x;
+  r.m[5] = y;
+  r.m[10] = z;
+  return r;
+}
+
+mat4 mat4_rotate_z(float radians) {
+  mat4 r = mat4_identity();
+  float c = cosf(radians), s = sinf(radians);
+  r.m[0] = c;
+  r.m[1] = s;
+  r.m[4] = -s;
+  r.m[5] = c;
+  return r;
+}
+
+// Keeps unit quads square on a non-square framebuffer by shrinking the
+// wider axis; this is the window_scale main.v.glsl used to hardcode.
+mat4 mat4_ortho_aspect(int width, int height) {
+  if(width <= 0 || height <= 0)
+    return mat4_identity();
+  if(width >= height)
+    return mat4_scale((float)height / width, 1.0f, 1.0f);
+  return mat4_scale(1.0f, (float)width / height, 1.0f);
+}
+
+// Transforms 'count' xyz points (w = 1) packed as floats.
+void mat4_transform_points(const mat4 &m, const float *in, float *out, int count) {
+#ifdef __SSE__
+  __m128 c0 = _mm_load_ps(m.m + 0);
+  __m128 c1 = _mm_load_ps(m.m + 4);
+  __m128 c2 = _mm_load_ps(m.m + 8);
+  __m128 c3 = _mm_load_ps(m.m + 12);
+  for(int i=0;i<count;i++) {
+    const float *p = in + i*3;
+    __m128 v = _mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(p[0])), _mm_mul_ps(c1, _mm_set1_ps(p[1])));
+    v = _mm_add_ps(v, _mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(p[2])), c3));
+    float tmp[4] __attribute__((aligned(16)));
+    _mm_store_ps(tmp, v);
+    out[i*3+0] = tmp[0];
+    out[i*3+1] = tmp[1];
+    out[i*3+2] = tmp[2];
+  }
+#else
+  for(int i=0;i<count;i++) {
+    const float *p = in + i*3;
+    float x = p[0], y = p[1], z = p[2];
+    out[i*3+0] = m.m[0]*x + m.m[4]*y + m.m[8]*z + m.m[12];
+    out[i*3+1] = m.m[1]*x + m.m[5]*y + m.m[9]*z + m.m[13];
+    out[i*3+2] = m.m[2]*x + m.m[6]*y + m.m[10]*z + m.m[14];
+  }
+#endif
+}
+
+mat3 mat3_identity() {
+  mat3 r;
+  memset(&r, 0, sizeof(r));
+  r.m[0] = r.m[5] = r.m[10] = 1.0f;
+  return r;
+}
+
+mat3 mat3_from_mat4(const mat4 &m) {
+  mat3 r;
+  memcpy(r.m, m.m, sizeof(r.m));
+  r.m[3] = r.m[7] = r.m[11] = 0.0f;
+  return r;
+}
+
+mat3 mat3_multiply(const mat3 &a, const mat3 &b) {
+  mat3 r;
+#ifdef __SSE__
+  __m128 a0 = _mm_load_ps(a.m + 0);
+  __m128 a1 = _mm_load_ps(a.m + 4);
+  __m128 a2 = _mm_load_ps(a.m + 8);
+  for(int j=0;j<3;j++) {
+    const float *bc = b.m + j*4;
+    __m128 c = _mm_mul_ps(a0, _mm_set1_ps(bc[0]));
+    c = _mm_add_ps(c, _mm_mul_ps(a1, _mm_set1_ps(bc[1])));
+    c = _mm_add_ps(c, _mm_mul_ps(a2, _mm_set1_ps(bc[2])));
+    _mm_store_ps(r.m + j*4, c);
+  }
+#else
+  for(int j=0;j<3;j++) {
+    for(int i=0;i<3;i++)
+      r.m[j*4+i] = a.m[i]*b.m[j*4] + a.m[4+i]*b.m[j*4+1] + a.m[8+i]*b.m[j*4+2];
+    r.m[j*4+3] = 0.0f;
+  }
+#endif
+  return r;
+}
+
+// translate * rotate * scale, written out directly rather than as two
+// full matrix products.
+mat4 transform_matrix(const transform2d &t) {
+  mat4 r = mat4_identity();
+  float c = cosf(t.rotation), s = sinf(t.rotation);
+  r.m[0] = c * t.scale_x;
+  r.m[1] = s * t.scale_x;
+  r.m[4] = -s * t.scale_y;
+  r.m[5] = c * t.scale_y;
+  r.m[12] = t.x;
+  r.m[13] = t.y;
+  r.m[14] = t.z;
+  return r;
+}
+
+void transform_matrices(const mat4 &view, const transform2d *t, mat4 *out, int count) {
+  for(int i=0;i<count;i++)
+    out[i] = mat4_multiply(view, transform_matrix(t[i]));
+}
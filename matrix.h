@@ -0,0 +1,38 @@
+#ifndef MATRIX_H
+#define MATRIX_H
+
+// Column-major matrices laid out to match GLSL and std140, so they can be
+// handed to glUniformMatrix*fv or copied into a uniform buffer as-is.
+// mat3 columns are padded to four floats, as std140 stores them.
+struct alignas(16) mat4 {
+  float m[16];
+};
+
+struct alignas(16) mat3 {
+  float m[12];
+};
+
+// Per-object placement, turned into a model matrix once per frame on the
+// CPU instead of per vertex in the shader.
+struct transform2d {
+  float x, y, z;
+  float rotation;
+  float scale_x, scale_y;
+};
+
+mat4 mat4_identity();
+mat4 mat4_multiply(const mat4 &a, const mat4 &b);
+mat4 mat4_translate(float x, float y, float z);
+mat4 mat4_scale(float x, float y, float z);
+mat4 mat4_rotate_z(float radians);
+mat4 mat4_ortho_aspect(int width, int height);
+void mat4_transform_points(const mat4 &m, const float *in, float *out, int count);
+
+mat3 mat3_identity();
+mat3 mat3_from_mat4(const mat4 &m);
+mat3 mat3_multiply(const mat3 &a, const mat3 &b);
+
+mat4 transform_matrix(const transform2d &t);
+void transform_matrices(const mat4 &view, const transform2d *t, mat4 *out, int count);
+
+#endif
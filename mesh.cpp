@@ -0,0 +1,114 @@
+#include "mesh.h"
+#include "mesh_optimize.h"
+#include "program_registry.h"
+#include "gl_state.h"
+#include "vertex_format.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// Takes a flat triangle list, welds identical vertices and hands the
+// result to make_indexed_mesh.
+mesh make_mesh(float *vertices, int size, const char *vertexFile, const char *fragmentFile)
+{
+  int vertex_count = size / MESH_VERTEX_FLOATS;
+  float *unique = (float *)malloc(vertex_count * MESH_VERTEX_FLOATS * sizeof(float));
+  unsigned *indices = (unsigned *)malloc(vertex_count * sizeof(unsigned));
+
+  int unique_count = weld_vertices(vertices, vertex_count, MESH_VERTEX_FLOATS, unique, indices);
+  fprintf(stderr, "mesh: welded %d vertices to %d\n", vertex_count, unique_count);
+
+  mesh m = make_indexed_mesh(unique, unique_count, indices, vertex_count, vertexFile, fragmentFile);
+  free(unique);
+  free(indices);
+  return m;
+}
+
+// Reorders 'indices' in place for the post-transform cache, then uploads
+// with the smallest index type that fits.
+mesh make_indexed_mesh(const float *vertices, int vertex_count, unsigned *indices, int index_count,
+                       const char *vertexFile, const char *fragmentFile)
+{
+  float before = vertex_cache_acmr(indices, index_count, vertex_count, ACMR_FIFO_SIZE);
+  optimize_vertex_cache(indices, index_count, vertex_count);
+  float after = vertex_cache_acmr(indices, index_count, vertex_count, ACMR_FIFO_SIZE);
+  fprintf(stderr, "mesh: %d triangles, ACMR %.3f -> %.3f\n", index_count / 3, before, after);
+
+  unsigned int VAO;
+  glGenVertexArrays(1, &VAO);
+  state_bind_vertex_array(VAO);
+  
+  int quantize = vertex_count >= MESH_QUANTIZE_MIN_VERTICES;
+  vertex_layout layout = compact_mesh_layout(quantize);
+  if(quantize)
+    vertex_layout_fit_positions(&layout, vertices, MESH_VERTEX_FLOATS, vertex_count, 0);
+  void *packed = malloc((size_t)vertex_count * layout.stride);
+  pack_vertices(&layout, vertices, MESH_VERTEX_FLOATS, vertex_count, packed);
+  fprintf(stderr, "mesh: %d vertices packed to %d bytes each (was %d)\n",
+          vertex_count, layout.stride, (int)(MESH_VERTEX_FLOATS*sizeof(float)));
+
+  unsigned int VBO;
+  glGenBuffers(1, &VBO);
+  state_bind_buffer(GL_ARRAY_BUFFER, VBO);
+  glBufferData(GL_ARRAY_BUFFER, (size_t)vertex_count*layout.stride, packed, GL_STATIC_DRAW);
+  free(packed);
+  vertex_layout_apply(&layout, 0);
+
+  // The element buffer binding is recorded in the VAO.
+  unsigned int EBO;
+  GLenum index_type;
+  glGenBuffers(1, &EBO);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+  if(vertex_count <= 0xFFFF) {
+    unsigned short *short_indices = (unsigned short *)malloc(index_count * sizeof(unsigned short));
+    for(int i=0;i<index_count;i++)
+      short_indices[i] = (unsigned short)indices[i];
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_count*sizeof(unsigned short), short_indices, GL_STATIC_DRAW);
+    free(short_indices);
+    index_type = GL_UNSIGNED_SHORT;
+  } else {
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_count*sizeof(unsigned), indices, GL_STATIC_DRAW);
+    index_type = GL_UNSIGNED_INT;
+  }
+
+  if(!vertexFile) vertexFile = "main.v.glsl";
+  if(!fragmentFile) fragmentFile = "main.f.glsl";
+
+  state_bind_vertex_array(0);
+
+  mesh m;
+  m.VAO = VAO;
+  m.vertex_buffer = VBO;
+  m.index_buffer = EBO;
+  m.index_count = index_count;
+  m.index_type = index_type;
+  m.local = layout.dequantize;
+  m.program_slot = acquire_program(vertexFile, fragmentFile, NULL);
+  m.shader_program = registry_program(m.program_slot);
+  return m;
+}
+
+void draw_mesh(mesh *m)
+{
+  draw_mesh_program(m, m->shader_program);
+}
+
+// Draws with another program taking the same vertex inputs.
+void draw_mesh_program(mesh *m, GLuint program)
+{
+  state_use_program(program);
+  state_bind_vertex_array(m->VAO);
+  glDrawElements(GL_TRIANGLES, m->index_count, m->index_type, (void *)0);
+}
+
+void destroy_mesh(mesh *m)
+{
+  state_forget_vertex_array(m->VAO);
+  state_forget_buffer(m->vertex_buffer);
+  glDeleteVertexArrays(1, &m->VAO);
+  glDeleteBuffers(1, &m->vertex_buffer);
+  glDeleteBuffers(1, &m->index_buffer);
+  release_program(m->program_slot);
+  m->VAO = m->vertex_buffer = m->index_buffer = m->shader_program = 0;
+  m->index_count = 0;
+  m->program_slot = -1;
+}
@@ -0,0 +1,32 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <glad/glad.h>
+#include "matrix.h"
+
+// Interleaved position (3), color (3) and uv (2) floats, as meshes are
+// built. On the GPU they are packed with compact_mesh_layout().
+#define MESH_VERTEX_FLOATS 8
+
+// Meshes at least this large get 16-bit quantized positions.
+#define MESH_QUANTIZE_MIN_VERTICES 4096
+
+struct mesh {
+  GLuint VAO;
+  GLuint vertex_buffer;
+  GLuint index_buffer;
+  GLsizei index_count;
+  GLenum index_type;
+  mat4 local;
+  GLuint shader_program;
+  int program_slot;
+};
+
+mesh make_mesh(float *vertices, int size, const char *vertexFile, const char *fragmentFile);
+mesh make_indexed_mesh(const float *vertices, int vertex_count, unsigned *indices, int index_count,
+                       const char *vertexFile, const char *fragmentFile);
+void draw_mesh(mesh *m);
+void draw_mesh_program(mesh *m, GLuint program);
+void destroy_mesh(mesh *m);
+
+#endif
@@ -0,0 +1,788 @@
+#include "mesh_loader.h"
+#include "vfs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <thread>
+
+#define LOADER_MAX_THREADS 32
+// Below this a single thread wins; thread startup isn't free.
+#define LOADER_MIN_CHUNK (256*1024)
+
+struct float_array {
+  float *data;
+  int count, capacity;
+};
+
+struct index_array {
+  int *data;
+  int count, capacity;
+};
+
+static void push_float(float_array *a, float v) {
+  if(a->count == a->capacity) {
+    a->capacity = a->capacity ? a->capacity * 2 : 4096;
+    a->data = (float *)realloc(a->data, a->capacity * sizeof(float));
+  }
+  a->data[a->count++] = v;
+}
+
+static void push_index(index_array *a, int v) {
+  if(a->count == a->capacity) {
+    a->capacity = a->capacity ? a->capacity * 2 : 4096;
+    a->data = (int *)realloc(a->data, a->capacity * sizeof(int));
+  }
+  a->data[a->count++] = v;
+}
+
+static double now_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static const double pow10_table[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+  1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static double pow10i(int e) {
+  double r = 1;
+  int n = e < 0 ? -e : e;
+  while(n > 22) {
+    r *= 1e22;
+    n -= 22;
+  }
+  r *= pow10_table[n];
+  return e < 0 ? 1 / r : r;
+}
+
+// Locale-independent decimal parser. Accumulates up to 19 significant
+// digits as an integer and scales once, which is exact enough for float
+// vertex data and several times faster than strtod. Skips leading blanks
+// and advances *cursor past the number.
+double parse_float(const char **cursor, const char *end) {
+  const char *p = *cursor;
+  while(p < end && (*p == ' ' || *p == '\t'))
+    p++;
+
+  int negative = 0;
+  if(p < end && (*p == '-' || *p == '+'))
+    negative = *p++ == '-';
+
+  unsigned long long mantissa = 0;
+  int digits = 0, exponent = 0;
+  while(p < end && *p >= '0' && *p <= '9') {
+    if(digits < 19) {
+      mantissa = mantissa * 10 + (*p - '0');
+      if(mantissa) digits++;
+    } else {
+      exponent++;
+    }
+    p++;
+  }
+  if(p < end && *p == '.') {
+    p++;
+    while(p < end && *p >= '0' && *p <= '9') {
+      if(digits < 19) {
+        mantissa = mantissa * 10 + (*p - '0');
+        if(mantissa) digits++;
+        exponent--;
+      }
+      p++;
+    }
+  }
+  if(p < end && (*p == 'e' || *p == 'E')) {
+    p++;
+    int eneg = 0, e = 0;
+    if(p < end && (*p == '-' || *p == '+'))
+      eneg = *p++ == '-';
+    while(p < end && *p >= '0' && *p <= '9')
+      e = e * 10 + (*p++ - '0');
+    exponent += eneg ? -e : e;
+  }
+
+  *cursor = p;
+  double value = mantissa * pow10i(exponent);
+  return negative ? -value : value;
+}
+
+static long parse_int(const char **cursor, const char *end) {
+  const char *p = *cursor;
+  while(p < end && (*p == ' ' || *p == '\t'))
+    p++;
+  int negative = 0;
+  if(p < end && (*p == '-' || *p == '+'))
+    negative = *p++ == '-';
+  long v = 0;
+  while(p < end && *p >= '0' && *p <= '9')
+    v = v * 10 + (*p++ - '0');
+  *cursor = p;
+  return negative ? -v : v;
+}
+
+static const char *next_line(const char *p, const char *end) {
+  const char *nl = (const char *)memchr(p, '\n', end - p);
+  return nl ? nl + 1 : end;
+}
+
+static int choose_threads(size_t bytes) {
+  int n = std::thread::hardware_concurrency();
+  if(n < 1) n = 1;
+  if(n > LOADER_MAX_THREADS) n = LOADER_MAX_THREADS;
+  while(n > 1 && bytes / n < LOADER_MIN_CHUNK)
+    n--;
+  return n;
+}
+
+// Splits [begin, end) into n pieces that each start at a line start.
+static void split_lines(const char *begin, const char *end, int n, const char **starts) {
+  size_t size = end - begin;
+  starts[0] = begin;
+  for(int i=1;i<n;i++) {
+    const char *p = begin + size * i / n;
+    if(p < starts[i-1]) p = starts[i-1];
+    starts[i] = p > begin && p[-1] == '\n' ? p : next_line(p, end);
+  }
+  starts[n] = end;
+}
+
+static void fan(index_array *out, const int *corners, int n) {
+  for(int i=1;i+1<n;i++) {
+    push_index(out, corners[0]);
+    push_index(out, corners[i]);
+    push_index(out, corners[i+1]);
+  }
+}
+
+// ---------------------------------------------------------------- OBJ
+
+struct obj_chunk {
+  const char *begin, *end;
+  float_array x, y, z, r, g, b;
+  int has_color;
+  index_array indices;
+  // Positions in 'indices' holding chunk-relative (negative OBJ) indices
+  // that need this chunk's global vertex base added after the merge.
+  index_array relative;
+};
+
+static void parse_obj_chunk(obj_chunk *c) {
+  const char *p = c->begin, *end = c->end;
+  int corners[64];
+
+  while(p < end) {
+    const char *line_end = next_line(p, end);
+    while(p < line_end && (*p == ' ' || *p == '\t'))
+      p++;
+
+    if(p + 1 < line_end && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+      const char *q = p + 1;
+      float v[6];
+      int n = 0;
+      while(n < 6) {
+        while(q < line_end && (*q == ' ' || *q == '\t')) q++;
+        if(q >= line_end || !(*q == '-' || *q == '+' || *q == '.' || (*q >= '0' && *q <= '9')))
+          break;
+        v[n++] = parse_float(&q, line_end);
+      }
+      push_float(&c->x, n > 0 ? v[0] : 0);
+      push_float(&c->y, n > 1 ? v[1] : 0);
+      push_float(&c->z, n > 2 ? v[2] : 0);
+      push_float(&c->r, n == 6 ? v[3] : 1);
+      push_float(&c->g, n == 6 ? v[4] : 1);
+      push_float(&c->b, n == 6 ? v[5] : 1);
+      if(n == 6)
+        c->has_color = 1;
+    } else if(p + 1 < line_end && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+      const char *q = p + 1;
+      int n = 0;
+      unsigned long long relative_mask = 0;
+      while(n < 64) {
+        while(q < line_end && (*q == ' ' || *q == '\t')) q++;
+        if(q >= line_end || *q == '\r' || *q == '\n')
+          break;
+        long index = parse_int(&q, line_end);
+        // Skip /vt/vn; texture and normal indices aren't used.
+        while(q < line_end && *q != ' ' && *q != '\t' && *q != '\r' && *q != '\n')
+          q++;
+        if(index > 0) {
+          corners[n] = (int)(index - 1);
+        } else if(index < 0) {
+          corners[n] = c->x.count + (int)index;
+          relative_mask |= 1ull << n;
+        } else {
+          continue;
+        }
+        n++;
+      }
+      int first = c->indices.count;
+      fan(&c->indices, corners, n);
+      if(relative_mask) {
+        // Each fan triangle i uses corners 0, i, i+1.
+        for(int t=0;t+2<n;t++) {
+          int used[3] = { 0, t+1, t+2 };
+          for(int k=0;k<3;k++)
+            if(relative_mask & (1ull << used[k]))
+              push_index(&c->relative, first + t*3 + k);
+        }
+      }
+    }
+    p = line_end;
+  }
+}
+
+static int load_obj(const char *data, size_t size, mesh_data *out, int *threads_used) {
+  int n = choose_threads(size);
+  const char *starts[LOADER_MAX_THREADS + 1];
+  split_lines(data, data + size, n, starts);
+
+  obj_chunk *chunks = (obj_chunk *)calloc(n, sizeof(obj_chunk));
+  std::thread workers[LOADER_MAX_THREADS];
+  for(int i=0;i<n;i++) {
+    chunks[i].begin = starts[i];
+    chunks[i].end = starts[i+1];
+    workers[i] = std::thread(parse_obj_chunk, &chunks[i]);
+  }
+  for(int i=0;i<n;i++)
+    workers[i].join();
+
+  int vertex_count = 0, index_count = 0, has_color = 0;
+  for(int i=0;i<n;i++) {
+    vertex_count += chunks[i].x.count;
+    index_count += chunks[i].indices.count;
+    has_color |= chunks[i].has_color;
+  }
+
+  out->vertex_count = vertex_count;
+  out->index_count = index_count;
+  out->x = (float *)malloc(vertex_count * sizeof(float));
+  out->y = (float *)malloc(vertex_count * sizeof(float));
+  out->z = (float *)malloc(vertex_count * sizeof(float));
+  out->r = out->g = out->b = NULL;
+  if(has_color) {
+    out->r = (float *)malloc(vertex_count * sizeof(float));
+    out->g = (float *)malloc(vertex_count * sizeof(float));
+    out->b = (float *)malloc(vertex_count * sizeof(float));
+  }
+  out->indices = (unsigned *)malloc(index_count * sizeof(unsigned));
+
+  int vbase = 0, ibase = 0, ok = 1;
+  for(int i=0;i<n;i++) {
+    obj_chunk *c = &chunks[i];
+    int vc = c->x.count, ic = c->indices.count;
+    memcpy(out->x + vbase, c->x.data, vc * sizeof(float));
+    memcpy(out->y + vbase, c->y.data, vc * sizeof(float));
+    memcpy(out->z + vbase, c->z.data, vc * sizeof(float));
+    if(has_color) {
+      memcpy(out->r + vbase, c->r.data, vc * sizeof(float));
+      memcpy(out->g + vbase, c->g.data, vc * sizeof(float));
+      memcpy(out->b + vbase, c->b.data, vc * sizeof(float));
+    }
+    for(int k=0;k<c->relative.count;k++)
+      c->indices.data[c->relative.data[k]] += vbase;
+    for(int k=0;k<ic;k++) {
+      int index = c->indices.data[k];
+      if(index < 0 || index >= vertex_count) {
+        ok = 0;
+        index = 0;
+      }
+      out->indices[ibase + k] = index;
+    }
+    vbase += vc;
+    ibase += ic;
+
+    free(c->x.data); free(c->y.data); free(c->z.data);
+    free(c->r.data); free(c->g.data); free(c->b.data);
+    free(c->indices.data);
+    free(c->relative.data);
+  }
+  free(chunks);
+
+  if(!ok)
+    fprintf(stderr, "mesh loader: face indices out of range, clamped to 0\n");
+  *threads_used = n;
+  return 1;
+}
+
+// ---------------------------------------------------------------- PLY
+
+enum ply_type { PLY_NONE, PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64 };
+
+#define PLY_MAX_PROPERTIES 32
+
+struct ply_header {
+  int binary;
+  int vertex_count, face_count;
+  int property_count;
+  ply_type types[PLY_MAX_PROPERTIES];
+  int offsets[PLY_MAX_PROPERTIES];
+  int vertex_size;
+  int px, py, pz, pr, pg, pb;   // property indices, -1 if absent
+  // Face properties in file order; face_count_types is PLY_NONE for a
+  // scalar. Only the vertex index list is used, the rest are skipped.
+  int face_property_count;
+  ply_type face_count_types[PLY_MAX_PROPERTIES], face_types[PLY_MAX_PROPERTIES];
+  int face_indices;             // -1 if absent
+  const char *body;
+};
+
+static ply_type ply_type_from(const char *name, int length) {
+  static const struct { const char *name; ply_type type; } names[] = {
+    { "char", PLY_INT8 }, { "int8", PLY_INT8 }, { "uchar", PLY_UINT8 }, { "uint8", PLY_UINT8 },
+    { "short", PLY_INT16 }, { "int16", PLY_INT16 }, { "ushort", PLY_UINT16 }, { "uint16", PLY_UINT16 },
+    { "int", PLY_INT32 }, { "int32", PLY_INT32 }, { "uint", PLY_UINT32 }, { "uint32", PLY_UINT32 },
+    { "float", PLY_FLOAT32 }, { "float32", PLY_FLOAT32 }, { "double", PLY_FLOAT64 }, { "float64", PLY_FLOAT64 }
+  };
+  for(unsigned i=0;i<sizeof(names)/sizeof(names[0]);i++)
+    if((int)strlen(names[i].name) == length && !strncmp(names[i].name, name, length))
+      return names[i].type;
+  return PLY_NONE;
+}
+
+static int ply_size(ply_type t) {
+  switch(t) {
+  case PLY_INT8: case PLY_UINT8: return 1;
+  case PLY_INT16: case PLY_UINT16: return 2;
+  case PLY_INT32: case PLY_UINT32: case PLY_FLOAT32: return 4;
+  case PLY_FLOAT64: return 8;
+  default: return 0;
+  }
+}
+
+static double ply_read(const unsigned char *p, ply_type t) {
+  switch(t) {
+  case PLY_INT8: return *(const signed char *)p;
+  case PLY_UINT8: return *p;
+  case PLY_INT16: { short v; memcpy(&v, p, 2); return v; }
+  case PLY_UINT16: { unsigned short v; memcpy(&v, p, 2); return v; }
+  case PLY_INT32: { int v; memcpy(&v, p, 4); return v; }
+  case PLY_UINT32: { unsigned v; memcpy(&v, p, 4); return v; }
+  case PLY_FLOAT32: { float v; memcpy(&v, p, 4); return v; }
+  case PLY_FLOAT64: { double v; memcpy(&v, p, 8); return v; }
+  default: return 0;
+  }
+}
+
+static int next_word(const char **p, const char *end, const char **word) {
+  while(*p < end && (**p == ' ' || **p == '\t' || **p == '\r'))
+    (*p)++;
+  *word = *p;
+  while(*p < end && **p != ' ' && **p != '\t' && **p != '\r' && **p != '\n')
+    (*p)++;
+  return (int)(*p - *word);
+}
+
+static int parse_ply_header(const char *data, size_t size, ply_header *h) {
+  const char *end = data + size;
+  const char *p = data;
+  int in_vertex = 0, in_face = 0;
+
+  memset(h, 0, sizeof(*h));
+  h->px = h->py = h->pz = h->pr = h->pg = h->pb = -1;
+  h->face_indices = -1;
+
+  while(p < end) {
+    const char *line_end = next_line(p, end);
+    const char *w;
+    int n = next_word(&p, line_end, &w);
+
+    if(n == 6 && !strncmp(w, "format", 6)) {
+      n = next_word(&p, line_end, &w);
+      if(n == 5 && !strncmp(w, "ascii", 5))
+        h->binary = 0;
+      else if(n == 20 && !strncmp(w, "binary_little_endian", 20))
+        h->binary = 1;
+      else {
+        fprintf(stderr, "mesh loader: unsupported PLY format %.*s\n", n, w);
+        return 0;
+      }
+    } else if(n == 7 && !strncmp(w, "element", 7)) {
+      n = next_word(&p, line_end, &w);
+      in_vertex = n == 6 && !strncmp(w, "vertex", 6);
+      in_face = n == 4 && !strncmp(w, "face", 4);
+      long count = parse_int(&p, line_end);
+      if(in_vertex) h->vertex_count = (int)count;
+      if(in_face) h->face_count = (int)count;
+      if(!in_vertex && !in_face && count > 0) {
+        fprintf(stderr, "mesh loader: unsupported PLY element %.*s\n", n, w);
+        return 0;
+      }
+    } else if(n == 8 && !strncmp(w, "property", 8)) {
+      n = next_word(&p, line_end, &w);
+      if(in_face) {
+        int list = n == 4 && !strncmp(w, "list", 4);
+        ply_type count_type = PLY_NONE;
+        if(list) {
+          n = next_word(&p, line_end, &w);
+          count_type = ply_type_from(w, n);
+          n = next_word(&p, line_end, &w);
+        }
+        ply_type t = ply_type_from(w, n);
+        int bad_count = list && (count_type == PLY_NONE || count_type == PLY_FLOAT32 || count_type == PLY_FLOAT64);
+        if(t == PLY_NONE || bad_count || h->face_property_count == PLY_MAX_PROPERTIES) {
+          fprintf(stderr, "mesh loader: unsupported PLY face property\n");
+          return 0;
+        }
+        int i = h->face_property_count++;
+        h->face_count_types[i] = count_type;
+        h->face_types[i] = t;
+        n = next_word(&p, line_end, &w);
+        // Some exporters say vertex_index; failing either name, the first
+        // list holds the corners.
+        int named = (n == 14 && !strncmp(w, "vertex_indices", 14)) || (n == 12 && !strncmp(w, "vertex_index", 12));
+        if(count_type != PLY_NONE && (named || h->face_indices < 0))
+          h->face_indices = i;
+      } else if(in_vertex) {
+        ply_type t = ply_type_from(w, n);
+        if(t == PLY_NONE || h->property_count == PLY_MAX_PROPERTIES) {
+          fprintf(stderr, "mesh loader: unsupported PLY vertex property\n");
+          return 0;
+        }
+        int i = h->property_count++;
+        h->types[i] = t;
+        h->offsets[i] = h->vertex_size;
+        h->vertex_size += ply_size(t);
+        n = next_word(&p, line_end, &w);
+        if(n == 1 && *w == 'x') h->px = i;
+        if(n == 1 && *w == 'y') h->py = i;
+        if(n == 1 && *w == 'z') h->pz = i;
+        if(n == 3 && !strncmp(w, "red", 3)) h->pr = i;
+        if(n == 5 && !strncmp(w, "green", 5)) h->pg = i;
+        if(n == 4 && !strncmp(w, "blue", 4)) h->pb = i;
+      }
+    } else if(n == 10 && !strncmp(w, "end_header", 10)) {
+      h->body = line_end;
+      if(h->face_count > 0 && h->face_indices < 0) {
+        fprintf(stderr, "mesh loader: PLY faces have no vertex index list\n");
+        return 0;
+      }
+      return h->px >= 0 && h->py >= 0 && h->pz >= 0;
+    }
+    p = line_end;
+  }
+  return 0;
+}
+
+// Colors in PLY are usually uchar 0-255, occasionally float 0-1.
+static float ply_color(double v, ply_type t) {
+  return t == PLY_FLOAT32 || t == PLY_FLOAT64 ? (float)v : (float)(v / 255.0);
+}
+
+struct ply_chunk {
+  const ply_header *h;
+  const char *begin, *end;
+  int first_line;
+  int lines;
+  mesh_data *out;
+  index_array indices;
+};
+
+static void count_lines(ply_chunk *c) {
+  int n = 0;
+  for(const char *p = c->begin; p < c->end; p = next_line(p, c->end))
+    n++;
+  c->lines = n;
+}
+
+static void parse_ply_ascii_chunk(ply_chunk *c) {
+  const ply_header *h = c->h;
+  mesh_data *out = c->out;
+  int line = c->first_line;
+  int has_color = out->r != NULL;
+  int corners[64];
+
+  for(const char *p = c->begin; p < c->end; line++) {
+    const char *line_end = next_line(p, c->end);
+    if(line < h->vertex_count) {
+      double v[PLY_MAX_PROPERTIES];
+      for(int i=0;i<h->property_count;i++)
+        v[i] = parse_float(&p, line_end);
+      out->x[line] = v[h->px];
+      out->y[line] = v[h->py];
+      out->z[line] = v[h->pz];
+      if(has_color) {
+        out->r[line] = ply_color(v[h->pr], h->types[h->pr]);
+        out->g[line] = ply_color(v[h->pg], h->types[h->pg]);
+        out->b[line] = ply_color(v[h->pb], h->types[h->pb]);
+      }
+    } else if(line < h->vertex_count + h->face_count) {
+      int m = 0;
+      for(int j=0;j<h->face_property_count;j++) {
+        if(h->face_count_types[j] == PLY_NONE) {
+          parse_float(&p, line_end);
+          continue;
+        }
+        int k = (int)parse_int(&p, line_end);
+        for(int i=0;i<k;i++) {
+          if(j != h->face_indices)
+            parse_float(&p, line_end);
+          else if(m < 64)
+            corners[m++] = (int)parse_int(&p, line_end);
+          else
+            parse_int(&p, line_end);
+        }
+      }
+      fan(&c->indices, corners, m);
+    }
+    p = line_end;
+  }
+}
+
+// Reads one binary face record at p, keeping up to 64 corners from the
+// index list. Returns the next record, or NULL if this one is truncated.
+static const unsigned char *read_ply_binary_face(const ply_header *h, const unsigned char *p,
+                                                 const unsigned char *end, int *corners, int *m) {
+  *m = 0;
+  for(int j=0;j<h->face_property_count;j++) {
+    ply_type count_type = h->face_count_types[j], type = h->face_types[j];
+    size_t size = ply_size(type);
+    if(count_type == PLY_NONE) {
+      if(size > (size_t)(end - p))
+        return NULL;
+      p += size;
+      continue;
+    }
+    size_t count_size = ply_size(count_type);
+    if(count_size > (size_t)(end - p))
+      return NULL;
+    long k = (long)ply_read(p, count_type);
+    p += count_size;
+    if(k < 0 || (size_t)k * size > (size_t)(end - p))
+      return NULL;
+    if(j == h->face_indices) {
+      *m = k > 64 ? 64 : (int)k;
+      for(int i=0;i<*m;i++)
+        corners[i] = (int)ply_read(p + i*size, type);
+    }
+    p += (size_t)k * size;
+  }
+  return p;
+}
+
+static void parse_ply_binary_vertices(ply_chunk *c) {
+  const ply_header *h = c->h;
+  mesh_data *out = c->out;
+  const unsigned char *base = (const unsigned char *)h->body;
+  int has_color = out->r != NULL;
+  for(int i=c->first_line;i<c->first_line + c->lines;i++) {
+    const unsigned char *v = base + (size_t)i * h->vertex_size;
+    out->x[i] = (float)ply_read(v + h->offsets[h->px], h->types[h->px]);
+    out->y[i] = (float)ply_read(v + h->offsets[h->py], h->types[h->py]);
+    out->z[i] = (float)ply_read(v + h->offsets[h->pz], h->types[h->pz]);
+    if(has_color) {
+      out->r[i] = ply_color(ply_read(v + h->offsets[h->pr], h->types[h->pr]), h->types[h->pr]);
+      out->g[i] = ply_color(ply_read(v + h->offsets[h->pg], h->types[h->pg]), h->types[h->pg]);
+      out->b[i] = ply_color(ply_read(v + h->offsets[h->pb], h->types[h->pb]), h->types[h->pb]);
+    }
+  }
+}
+
+static int load_ply(const char *data, size_t size, mesh_data *out, int *threads_used) {
+  ply_header h;
+  if(!parse_ply_header(data, size, &h)) {
+    fprintf(stderr, "mesh loader: bad PLY header\n");
+    return 0;
+  }
+
+  const char *end = data + size;
+  int vertex_count = h.vertex_count;
+  int has_color = h.pr >= 0 && h.pg >= 0 && h.pb >= 0;
+  out->vertex_count = vertex_count;
+  out->x = (float *)malloc(vertex_count * sizeof(float));
+  out->y = (float *)malloc(vertex_count * sizeof(float));
+  out->z = (float *)malloc(vertex_count * sizeof(float));
+  out->r = out->g = out->b = NULL;
+  if(has_color) {
+    out->r = (float *)malloc(vertex_count * sizeof(float));
+    out->g = (float *)malloc(vertex_count * sizeof(float));
+    out->b = (float *)malloc(vertex_count * sizeof(float));
+  }
+
+  int n = choose_threads(end - h.body);
+  ply_chunk *chunks = (ply_chunk *)calloc(n, sizeof(ply_chunk));
+  std::thread workers[LOADER_MAX_THREADS];
+
+  if(!h.binary) {
+    // Two passes: count lines per chunk to learn where each chunk starts
+    // in the element list, then parse with that known line number.
+    const char *starts[LOADER_MAX_THREADS + 1];
+    split_lines(h.body, end, n, starts);
+    for(int i=0;i<n;i++) {
+      chunks[i].h = &h;
+      chunks[i].begin = starts[i];
+      chunks[i].end = starts[i+1];
+      chunks[i].out = out;
+      workers[i] = std::thread(count_lines, &chunks[i]);
+    }
+    for(int i=0;i<n;i++)
+      workers[i].join();
+    int line = 0;
+    for(int i=0;i<n;i++) {
+      chunks[i].first_line = line;
+      line += chunks[i].lines;
+      workers[i] = std::thread(parse_ply_ascii_chunk, &chunks[i]);
+    }
+    for(int i=0;i<n;i++)
+      workers[i].join();
+  } else {
+    size_t vertex_bytes = (size_t)vertex_count * h.vertex_size;
+    if(h.body + vertex_bytes > end) {
+      fprintf(stderr, "mesh loader: truncated PLY vertex data\n");
+      n = 0;
+    }
+    // Fixed-size records: split the vertex range evenly.
+    for(int i=0;i<n;i++) {
+      chunks[i].h = &h;
+      chunks[i].out = out;
+      chunks[i].first_line = (int)((long long)vertex_count * i / n);
+      chunks[i].lines = (int)((long long)vertex_count * (i+1) / n) - chunks[i].first_line;
+      workers[i] = std::thread(parse_ply_binary_vertices, &chunks[i]);
+    }
+    for(int i=0;i<n;i++)
+      workers[i].join();
+
+    // Faces are variable length, so they are walked on this thread.
+    if(n > 0) {
+      const unsigned char *p = (const unsigned char *)h.body + vertex_bytes;
+      const unsigned char *bend = (const unsigned char *)end;
+      int corners[64], m;
+      for(int f=0;f<h.face_count && p;f++) {
+        p = read_ply_binary_face(&h, p, bend, corners, &m);
+        if(p)
+          fan(&chunks[0].indices, corners, m);
+      }
+    }
+  }
+
+  int index_count = 0;
+  for(int i=0;i<n;i++)
+    index_count += chunks[i].indices.count;
+  out->index_count = index_count;
+  out->indices = (unsigned *)malloc(index_count * sizeof(unsigned));
+  int ibase = 0, ok = 1;
+  for(int i=0;i<n;i++) {
+    for(int k=0;k<chunks[i].indices.count;k++) {
+      int index = chunks[i].indices.data[k];
+      if(index < 0 || index >= vertex_count) {
+        ok = 0;
+        index = 0;
+      }
+      out->indices[ibase++] = index;
+    }
+    free(chunks[i].indices.data);
+  }
+  free(chunks);
+
+  if(!ok)
+    fprintf(stderr, "mesh loader: face indices out of range, clamped to 0\n");
+  *threads_used = n;
+  return 1;
+}
+
+// ---------------------------------------------------------------- API
+
+int load_mesh_file(const char *path, mesh_data *out) {
+  memset(out, 0, sizeof(*out));
+
+  double start = now_seconds();
+  vfs_file file;
+  if(!vfs_open(path, &file) || !file.size) {
+    fprintf(stderr, "Unable to open %s for reading\n", path);
+    vfs_close(&file);
+    return 0;
+  }
+  vfs_advise(&file, MADV_WILLNEED);
+  const char *data = file.data;
+  size_t size = file.size;
+
+  const char *ext = strrchr(path, '.');
+  int threads = 1, ok;
+  if(ext && !strcasecmp(ext, ".ply"))
+    ok = load_ply(data, size, out, &threads);
+  else
+    ok = load_obj(data, size, out, &threads);
+  vfs_close(&file);
+
+  double elapsed = now_seconds() - start;
+  if(ok)
+    fprintf(stderr, "mesh loader: %s: %d vertices, %d triangles, %.1f MB in %.1f ms (%.0f MB/s, %d threads)\n",
+            path, out->vertex_count, out->index_count / 3, size / 1e6, elapsed * 1000,
+            elapsed > 0 ? size / 1e6 / elapsed : 0, threads);
+  else
+    free_mesh_data(out);
+  return ok;
+}
+
+void free_mesh_data(mesh_data *d) {
+  free(d->x); free(d->y); free(d->z);
+  free(d->r); free(d->g); free(d->b);
+  free(d->indices);
+  memset(d, 0, sizeof(*d));
+}
+
+void mesh_data_bounds(const mesh_data *d, float lo[3], float hi[3]) {
+  const float *axes[3] = { d->x, d->y, d->z };
+  for(int k=0;k<3;k++) {
+    lo[k] = d->vertex_count ? axes[k][0] : 0;
+    hi[k] = lo[k];
+    for(int i=1;i<d->vertex_count;i++) {
+      if(axes[k][i] < lo[k]) lo[k] = axes[k][i];
+      if(axes[k][i] > hi[k]) hi[k] = axes[k][i];
+    }
+  }
+}
+
+// Interleaves into the MESH_VERTEX_FLOATS layout and builds an indexed,
+// cache-optimized GL mesh.
+mesh mesh_from_data(const mesh_data *d, const char *vertexFile, const char *fragmentFile) {
+  float *vertices = (float *)malloc((size_t)d->vertex_count * MESH_VERTEX_FLOATS * sizeof(float));
+  unsigned *indices = (unsigned *)malloc((size_t)d->index_count * sizeof(unsigned));
+  for(int i=0;i<d->vertex_count;i++) {
+    float *v = vertices + (size_t)i * MESH_VERTEX_FLOATS;
+    v[0] = d->x[i];
+    v[1] = d->y[i];
+    v[2] = d->z[i];
+    v[3] = d->r ? d->r[i] : 1;
+    v[4] = d->g ? d->g[i] : 1;
+    v[5] = d->b ? d->b[i] : 1;
+    v[6] = 0;
+    v[7] = 0;
+  }
+  memcpy(indices, d->indices, (size_t)d->index_count * sizeof(unsigned));
+
+  mesh m = make_indexed_mesh(vertices, d->vertex_count, indices, d->index_count, vertexFile, fragmentFile);
+  free(vertices);
+  free(indices);
+  return m;
+}
+
+int mesh_data_triangles(const mesh_data *d, triangle_list *out) {
+  int count = d->index_count / 3;
+  out->count = count;
+  for(int k=0;k<3;k++) {
+    out->x[k] = (float *)malloc(count * sizeof(float));
+    out->y[k] = (float *)malloc(count * sizeof(float));
+    out->z[k] = (float *)malloc(count * sizeof(float));
+  }
+  for(int t=0;t<count;t++) {
+    for(int k=0;k<3;k++) {
+      unsigned i = d->indices[t*3+k];
+      out->x[k][t] = d->x[i];
+      out->y[k][t] = d->y[i];
+      out->z[k][t] = d->z[i];
+    }
+  }
+  return count;
+}
+
+void free_triangle_list(triangle_list *t) {
+  for(int k=0;k<3;k++) {
+    free(t->x[k]);
+    free(t->y[k]);
+    free(t->z[k]);
+  }
+  memset(t, 0, sizeof(*t));
+}
@@ -0,0 +1,33 @@
+#ifndef MESH_LOADER_H
+#define MESH_LOADER_H
+
+#include "mesh.h"
+
+// Geometry as loaded from disk, structure-of-arrays. Colors are NULL when
+// the file has none.
+struct mesh_data {
+  float *x, *y, *z;
+  float *r, *g, *b;
+  int vertex_count;
+  unsigned *indices;
+  int index_count;
+};
+
+// Flat triangle list for the CPU tracer: corner k of triangle i is
+// (x[k][i], y[k][i], z[k][i]).
+struct triangle_list {
+  float *x[3], *y[3], *z[3];
+  int count;
+};
+
+int load_mesh_file(const char *path, mesh_data *out);
+void free_mesh_data(mesh_data *d);
+void mesh_data_bounds(const mesh_data *d, float lo[3], float hi[3]);
+
+mesh mesh_from_data(const mesh_data *d, const char *vertexFile, const char *fragmentFile);
+int mesh_data_triangles(const mesh_data *d, triangle_list *out);
+void free_triangle_list(triangle_list *t);
+
+double parse_float(const char **cursor, const char *end);
+
+#endif
@@ -0,0 +1,210 @@
+#include "mesh_optimize.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+static unsigned hash_vertex(const float *v, int stride) {
+  const unsigned char *p = (const unsigned char *)v;
+  unsigned h = 2166136261u;
+  for(int i=0;i<stride*(int)sizeof(float);i++) {
+    h ^= p[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+// Collapses bit-identical vertices. 'unique' must have room for
+// vertex_count vertices and 'indices' for vertex_count indices. Returns
+// the number of unique vertices written.
+int weld_vertices(const float *vertices, int vertex_count, int stride, float *unique, unsigned *indices) {
+  int table_size = 1;
+  while(table_size < vertex_count * 2)
+    table_size <<= 1;
+  int *table = (int *)malloc(table_size * sizeof(int));
+  memset(table, -1, table_size * sizeof(int));
+
+  int count = 0;
+  for(int i=0;i<vertex_count;i++) {
+    const float *v = vertices + i*stride;
+    unsigned slot = hash_vertex(v, stride) & (table_size - 1);
+    while(table[slot] >= 0 && memcmp(unique + table[slot]*stride, v, stride*sizeof(float)))
+      slot = (slot + 1) & (table_size - 1);
+
+    if(table[slot] < 0) {
+      memcpy(unique + count*stride, v, stride*sizeof(float));
+      table[slot] = count++;
+    }
+    indices[i] = table[slot];
+  }
+
+  free(table);
+  return count;
+}
+
+// Average cache miss ratio: transformed vertices per triangle with a FIFO
+// post-transform cache. 0.5 is the ideal for a large regular grid, 3.0
+// means no reuse at all.
+float vertex_cache_acmr(const unsigned *indices, int index_count, int vertex_count, int cache_size) {
+  if(index_count < 3)
+    return 0;
+
+  int *timestamp = (int *)malloc(vertex_count * sizeof(int));
+  for(int i=0;i<vertex_count;i++)
+    timestamp[i] = -cache_size - 1;
+
+  int misses = 0;
+  for(int i=0;i<index_count;i++) {
+    unsigned v = indices[i];
+    if(misses - timestamp[v] > cache_size) {
+      timestamp[v] = misses;
+      misses++;
+    }
+  }
+
+  free(timestamp);
+  return (float)misses / (index_count / 3);
+}
+
+// Tom Forsyth's linear-speed vertex cache optimisation. Triangles are
+// emitted greedily by a score that favours vertices recently used (high
+// in a modelled LRU cache) and vertices with few remaining triangles, so
+// meshes don't leave stragglers that force reloads later.
+
+#define FORSYTH_CACHE_DECAY_POWER 1.5f
+#define FORSYTH_LAST_TRI_SCORE 0.75f
+#define FORSYTH_VALENCE_BOOST_SCALE 2.0f
+#define FORSYTH_VALENCE_BOOST_POWER 0.5f
+
+static float vertex_score(int cache_position, int remaining) {
+  if(remaining == 0)
+    return -1.0f;
+
+  float score = 0.0f;
+  if(cache_position >= 0) {
+    if(cache_position < 3) {
+      score = FORSYTH_LAST_TRI_SCORE;
+    } else {
+      float scaler = 1.0f / (VERTEX_CACHE_SIZE - 3);
+      score = powf(1.0f - (cache_position - 3) * scaler, FORSYTH_CACHE_DECAY_POWER);
+    }
+  }
+  score += FORSYTH_VALENCE_BOOST_SCALE * powf((float)remaining, -FORSYTH_VALENCE_BOOST_POWER);
+  return score;
+}
+
+void optimize_vertex_cache(unsigned *indices, int index_count, int vertex_count) {
+  int tri_count = index_count / 3;
+  if(tri_count <= 0 || vertex_count <= 0)
+    return;
+
+  // Vertex -> triangle adjacency in one flat array.
+  int *offsets = (int *)calloc(vertex_count + 1, sizeof(int));
+  int *remaining = (int *)calloc(vertex_count, sizeof(int));
+  for(int i=0;i<index_count;i++)
+    remaining[indices[i]]++;
+  for(int v=0;v<vertex_count;v++)
+    offsets[v+1] = offsets[v] + remaining[v];
+  int *adjacency = (int *)malloc(index_count * sizeof(int));
+  int *fill = (int *)malloc(vertex_count * sizeof(int));
+  memcpy(fill, offsets, vertex_count * sizeof(int));
+  for(int t=0;t<tri_count;t++)
+    for(int k=0;k<3;k++)
+      adjacency[fill[indices[t*3+k]]++] = t;
+
+  int *cache_position = (int *)malloc(vertex_count * sizeof(int));
+  float *score = (float *)malloc(vertex_count * sizeof(float));
+  for(int v=0;v<vertex_count;v++) {
+    cache_position[v] = -1;
+    score[v] = vertex_score(-1, remaining[v]);
+  }
+
+  float *tri_score = (float *)malloc(tri_count * sizeof(float));
+  char *emitted = (char *)calloc(tri_count, 1);
+  for(int t=0;t<tri_count;t++)
+    tri_score[t] = score[indices[t*3]] + score[indices[t*3+1]] + score[indices[t*3+2]];
+
+  unsigned *output = (unsigned *)malloc(index_count * sizeof(unsigned));
+  int cache[VERTEX_CACHE_SIZE + 3];
+  int cache_count = 0;
+  int scan = 0;
+
+  int best = 0;
+  for(int t=1;t<tri_count;t++)
+    if(tri_score[t] > tri_score[best])
+      best = t;
+
+  for(int out=0; out<tri_count; out++) {
+    if(best < 0) {
+      // Nothing in the cache touches an unemitted triangle; resume the
+      // linear scan for the next one.
+      while(scan < tri_count && emitted[scan])
+        scan++;
+      best = scan;
+    }
+
+    emitted[best] = 1;
+    unsigned *tri = indices + best*3;
+    memcpy(output + out*3, tri, 3*sizeof(unsigned));
+
+    // Move the triangle's vertices to the front of the LRU cache.
+    int new_cache[VERTEX_CACHE_SIZE + 3];
+    int n = 0;
+    for(int k=0;k<3;k++) {
+      new_cache[n++] = tri[k];
+      remaining[tri[k]]--;
+      // Drop the triangle from the vertex's adjacency list.
+      int *list = adjacency + offsets[tri[k]];
+      int len = remaining[tri[k]] + 1;
+      for(int j=0;j<len;j++) {
+        if(list[j] == best) {
+          list[j] = list[len-1];
+          break;
+        }
+      }
+    }
+    for(int i=0;i<cache_count;i++) {
+      int v = cache[i];
+      if(v != (int)tri[0] && v != (int)tri[1] && v != (int)tri[2])
+        new_cache[n++] = v;
+    }
+
+    // Rescore everything that was in the cache, including vertices that
+    // just fell out of it.
+    for(int i=0;i<n;i++) {
+      int v = new_cache[i];
+      cache_position[v] = i < VERTEX_CACHE_SIZE ? i : -1;
+      score[v] = vertex_score(cache_position[v], remaining[v]);
+    }
+
+    best = -1;
+    float best_score = -1.0f;
+    for(int i=0;i<n;i++) {
+      int v = new_cache[i];
+      int *list = adjacency + offsets[v];
+      for(int j=0;j<remaining[v];j++) {
+        int t = list[j];
+        float s = score[indices[t*3]] + score[indices[t*3+1]] + score[indices[t*3+2]];
+        tri_score[t] = s;
+        if(s > best_score) {
+          best_score = s;
+          best = t;
+        }
+      }
+    }
+
+    cache_count = n < VERTEX_CACHE_SIZE ? n : VERTEX_CACHE_SIZE;
+    memcpy(cache, new_cache, cache_count * sizeof(int));
+  }
+
+  memcpy(indices, output, index_count * sizeof(unsigned));
+
+  free(output);
+  free(emitted);
+  free(tri_score);
+  free(score);
+  free(cache_position);
+  free(fill);
+  free(adjacency);
+  free(remaining);
+  free(offsets);
+}
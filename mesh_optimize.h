@@ -0,0 +1,11 @@
+#ifndef MESH_OPTIMIZE_H
+#define MESH_OPTIMIZE_H
+
+#define VERTEX_CACHE_SIZE 32
+#define ACMR_FIFO_SIZE 16
+
+int weld_vertices(const float *vertices, int vertex_count, int stride, float *unique, unsigned *indices);
+void optimize_vertex_cache(unsigned *indices, int index_count, int vertex_count);
+float vertex_cache_acmr(const unsigned *indices, int index_count, int vertex_count, int cache_size);
+
+#endif
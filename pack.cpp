@@ -0,0 +1,141 @@
+// Builds a vfs pack from loose files. Entries are stored under the names
+// given on the command line, so pack from the directory the game runs in:
+//
+//   ./pack assets.pak main.v.glsl main.f.glsl uniforms.glsl container.tex
+//
+// With --cpp the pack is written as a C++ source defining embedded_pack
+// (see embedded_assets.h) instead, for build.sh to compile into main.
+
+#include "vfs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct pack_input {
+  const char *name;
+  unsigned char *data;
+  size_t size;
+  vfs_pack_entry entry;
+};
+
+static unsigned char *read_whole_file(const char *path, size_t *size) {
+  FILE *f = fopen(path, "rb");
+  if(!f) {
+    fprintf(stderr, "Unable to open %s for reading\n", path);
+    return NULL;
+  }
+  fseek(f, 0, SEEK_END);
+  long length = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  unsigned char *data = (unsigned char *)malloc(length > 0 ? length : 1);
+  *size = fread(data, 1, length, f);
+  fclose(f);
+  return data;
+}
+
+static int by_hash(const void *a, const void *b) {
+  uint64_t x = ((const pack_input *)a)->entry.hash, y = ((const pack_input *)b)->entry.hash;
+  return x < y ? -1 : x > y;
+}
+
+static uint64_t align_up(uint64_t at, uint64_t alignment) {
+  return (at + alignment - 1) & ~(alignment - 1);
+}
+
+// Lays out header, sorted entry table, names and data in one zeroed
+// buffer. Returns NULL if a name is listed twice.
+static unsigned char *build_pack(pack_input *inputs, int count, size_t *size) {
+  uint32_t names_size = 0;
+  for(int i=0;i<count;i++) {
+    inputs[i].entry.hash = vfs_hash(inputs[i].name);
+    inputs[i].entry.name_offset = names_size;
+    names_size += strlen(inputs[i].name) + 1;
+  }
+  qsort(inputs, count, sizeof(pack_input), by_hash);
+  for(int i=1;i<count;i++) {
+    if(inputs[i].entry.hash == inputs[i-1].entry.hash && !strcmp(inputs[i].name, inputs[i-1].name)) {
+      fprintf(stderr, "%s is listed twice\n", inputs[i].name);
+      return NULL;
+    }
+  }
+
+  vfs_pack_header h;
+  memset(&h, 0, sizeof(h));
+  h.magic = VFS_PACK_MAGIC;
+  h.version = VFS_PACK_VERSION;
+  h.entry_count = count;
+  h.names_offset = sizeof(h) + (uint64_t)count * sizeof(vfs_pack_entry);
+  h.names_size = names_size;
+  uint64_t at = h.names_offset + names_size;
+  for(int i=0;i<count;i++) {
+    vfs_pack_entry *e = &inputs[i].entry;
+    at = align_up(at, inputs[i].size >= VFS_PACK_PAGE ? VFS_PACK_PAGE : VFS_PACK_ALIGNMENT);
+    e->offset = at;
+    e->size = inputs[i].size;
+    at += e->size + 1;
+  }
+
+  unsigned char *image = (unsigned char *)calloc(at, 1);
+  memcpy(image, &h, sizeof(h));
+  for(int i=0;i<count;i++) {
+    const vfs_pack_entry *e = &inputs[i].entry;
+    memcpy(image + sizeof(h) + i * sizeof(vfs_pack_entry), e, sizeof(*e));
+    memcpy(image + h.names_offset + e->name_offset, inputs[i].name, strlen(inputs[i].name) + 1);
+    memcpy(image + e->offset, inputs[i].data, e->size);
+  }
+  *size = at;
+  return image;
+}
+
+static int write_cpp(FILE *f, const unsigned char *image, size_t size) {
+  fprintf(f, "// Generated by pack --cpp; do not edit.\n"
+          "#include \"embedded_assets.h\"\n\n"
+          "alignas(%d) const unsigned char embedded_pack[] = {\n", VFS_PACK_PAGE);
+  for(size_t i=0;i<size;i++)
+    fprintf(f, "%u,%s", image[i], i % 24 == 23 ? "\n" : "");
+  fprintf(f, "\n};\nconst size_t embedded_pack_size = %zu;\n", size);
+  return !ferror(f);
+}
+
+int main(int argc, char **argv) {
+  int cpp = argc > 1 && !strcmp(argv[1], "--cpp");
+  char **args = argv + 1 + cpp;
+  int count = argc - 2 - cpp;
+  if(count < 1) {
+    fprintf(stderr, "usage: %s [--cpp] output file...\n", argv[0]);
+    return 1;
+  }
+  pack_input *inputs = (pack_input *)calloc(count, sizeof(pack_input));
+  for(int i=0;i<count;i++) {
+    pack_input *in = &inputs[i];
+    in->name = args[i + 1];
+    while(in->name[0] == '.' && in->name[1] == '/')
+      in->name += 2;
+    in->data = read_whole_file(args[i + 1], &in->size);
+    if(!in->data)
+      return 1;
+  }
+  size_t size;
+  unsigned char *image = build_pack(inputs, count, &size);
+  if(!image)
+    return 1;
+
+  FILE *f = fopen(args[0], cpp ? "w" : "wb");
+  if(!f) {
+    fprintf(stderr, "Unable to open %s for writing\n", args[0]);
+    return 1;
+  }
+  int ok = cpp ? write_cpp(f, image, size) : fwrite(image, 1, size, f) == size;
+  if(fclose(f) != 0)
+    ok = 0;
+  if(ok)
+    fprintf(stderr, "%s: %d entries, %.1f MB\n", args[0], count, size / (1024.0 * 1024.0));
+  else
+    fprintf(stderr, "Failed writing %s\n", args[0]);
+
+  free(image);
+  for(int i=0;i<count;i++)
+    free(inputs[i].data);
+  free(inputs);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,187 @@
+#include "program_registry.h"
+#include "shader.h"
+#include "shader_variant.h"
+#include "uniform_ring.h"
+#include "gl_state.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct retired_program {
+  GLuint program;
+  int frame;
+};
+
+static program_entry *entries;
+static int entry_count, entry_capacity;
+
+// Programs replaced by a reload, waiting out the frames in flight.
+static retired_program *retired;
+static int retired_count, retired_capacity;
+
+static int current_frame;
+
+static void retire(GLuint program) {
+  if(retired_count == retired_capacity) {
+    retired_capacity = retired_capacity ? retired_capacity * 2 : 8;
+    retired = (retired_program *)realloc(retired, retired_capacity * sizeof(retired_program));
+  }
+  retired[retired_count].program = program;
+  retired[retired_count].frame = current_frame;
+  retired_count++;
+}
+
+// Returns a slot, or -1 if the program failed to build. A program whose
+// last reference was dropped but which hasn't been collected yet is
+// revived instead of recompiled.
+int acquire_program(const char *vertexFile, const char *fragmentFile, const char *defines) {
+  char *key = normalize_defines(defines);
+  int free_slot = -1;
+
+  for(int i=0;i<entry_count;i++) {
+    program_entry *e = &entries[i];
+    if(!e->vertex_file) {
+      if(free_slot < 0) free_slot = i;
+      continue;
+    }
+    if(!strcmp(e->vertex_file, vertexFile) && !strcmp(e->fragment_file, fragmentFile) &&
+       !strcmp(e->defines, key)) {
+      free(key);
+      e->refcount++;
+      e->retired_frame = -1;
+      return i;
+    }
+  }
+
+  GLuint program = getShaderVariant(vertexFile, fragmentFile, key);
+  if(!program) {
+    free(key);
+    return -1;
+  }
+  bind_uniform_blocks(program);
+
+  if(free_slot < 0) {
+    if(entry_count == entry_capacity) {
+      entry_capacity = entry_capacity ? entry_capacity * 2 : 16;
+      entries = (program_entry *)realloc(entries, entry_capacity * sizeof(program_entry));
+    }
+    free_slot = entry_count++;
+  }
+
+  program_entry *e = &entries[free_slot];
+  e->vertex_file = strdup(vertexFile);
+  e->fragment_file = strdup(fragmentFile);
+  e->defines = key;
+  e->program = program;
+  e->refcount = 1;
+  e->retired_frame = -1;
+  return free_slot;
+}
+
+// Acquires a declared set of variants of one pair, e.g. during loading,
+// so the first frame that needs one doesn't stall on the compiler. Each
+// slot is released as usual; returns how many built.
+int precompile_programs(const char *vertexFile, const char *fragmentFile, const char **defines,
+                        int count, int *slots) {
+  int built = 0;
+  for(int i=0;i<count;i++) {
+    slots[i] = acquire_program(vertexFile, fragmentFile, defines[i]);
+    if(slots[i] >= 0)
+      built++;
+    else
+      fprintf(stderr, "Variant [%s] of %s + %s failed to build\n", defines[i] ? defines[i] : "",
+              vertexFile, fragmentFile);
+  }
+  return built;
+}
+
+void release_program(int slot) {
+  if(slot < 0 || slot >= entry_count || !entries[slot].vertex_file)
+    return;
+  program_entry *e = &entries[slot];
+  if(--e->refcount <= 0) {
+    e->refcount = 0;
+    e->retired_frame = current_frame;
+  }
+}
+
+GLuint registry_program(int slot) {
+  if(slot < 0 || slot >= entry_count)
+    return 0;
+  return entries[slot].program;
+}
+
+// Swaps in a relinked program for every user of the slot. The old one is
+// deleted once it can no longer be in flight.
+void registry_replace_program(int slot, GLuint program) {
+  if(slot < 0 || slot >= entry_count || !entries[slot].vertex_file)
+    return;
+  if(entries[slot].program)
+    retire(entries[slot].program);
+  bind_uniform_blocks(program);
+  entries[slot].program = program;
+}
+
+// Call once per frame. Deletes unreferenced and replaced programs that
+// have been idle for PROGRAM_RETIRE_FRAMES.
+void collect_programs(int frame) {
+  current_frame = frame;
+
+  for(int i=0;i<entry_count;i++) {
+    program_entry *e = &entries[i];
+    if(!e->vertex_file || e->refcount > 0 || e->retired_frame < 0)
+      continue;
+    if(frame - e->retired_frame < PROGRAM_RETIRE_FRAMES)
+      continue;
+    state_forget_program(e->program);
+    glDeleteProgram(e->program);
+    free(e->vertex_file);
+    free(e->fragment_file);
+    free(e->defines);
+    memset(e, 0, sizeof(*e));
+  }
+
+  int kept = 0;
+  for(int i=0;i<retired_count;i++) {
+    if(frame - retired[i].frame >= PROGRAM_RETIRE_FRAMES) {
+      state_forget_program(retired[i].program);
+      glDeleteProgram(retired[i].program);
+    } else {
+      retired[kept++] = retired[i];
+    }
+  }
+  retired_count = kept;
+}
+
+void destroy_program_registry() {
+  for(int i=0;i<entry_count;i++) {
+    if(!entries[i].vertex_file)
+      continue;
+    state_forget_program(entries[i].program);
+    glDeleteProgram(entries[i].program);
+    free(entries[i].vertex_file);
+    free(entries[i].fragment_file);
+    free(entries[i].defines);
+  }
+  for(int i=0;i<retired_count;i++) {
+    state_forget_program(retired[i].program);
+    glDeleteProgram(retired[i].program);
+  }
+  free(entries);
+  free(retired);
+  entries = NULL;
+  retired = NULL;
+  entry_count = entry_capacity = 0;
+  retired_count = retired_capacity = 0;
+}
+
+void registry_stats(int *programs, int *references) {
+  *programs = 0;
+  *references = 0;
+  for(int i=0;i<entry_count;i++) {
+    if(!entries[i].vertex_file)
+      continue;
+    (*programs)++;
+    *references += entries[i].refcount;
+  }
+}
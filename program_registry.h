@@ -0,0 +1,33 @@
+#ifndef PROGRAM_REGISTRY_H
+#define PROGRAM_REGISTRY_H
+
+#include <glad/glad.h>
+
+// Programs released this many frames ago are no longer referenced by
+// commands still in flight and can be deleted.
+#define PROGRAM_RETIRE_FRAMES 3
+
+// One shared, reference counted program per (vertex, fragment, defines)
+// key. Slots are stable for the life of the registry, so meshes hold a
+// slot and look up the current program when drawing; a hot reload then
+// updates every mesh that shares it.
+struct program_entry {
+  char *vertex_file;
+  char *fragment_file;
+  char *defines;
+  GLuint program;
+  int refcount;
+  int retired_frame;
+};
+
+int acquire_program(const char *vertexFile, const char *fragmentFile, const char *defines);
+int precompile_programs(const char *vertexFile, const char *fragmentFile, const char **defines,
+                        int count, int *slots);
+void release_program(int slot);
+GLuint registry_program(int slot);
+void registry_replace_program(int slot, GLuint program);
+void collect_programs(int frame);
+void destroy_program_registry();
+void registry_stats(int *programs, int *references);
+
+#endif
@@ -0,0 +1,139 @@
+#include "shader.h"
+#include "shader_cache.h"
+#include "shader_variant.h"
+#include "vfs.h"
+#include <GLFW/glfw3.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+GLuint getShaderProgram(const char *vertexFile, const char *fragmentFile)
+{
+  return getShaderVariant(vertexFile, fragmentFile, NULL);
+}
+
+GLuint getShaderVariant(const char *vertexFile, const char *fragmentFile, const char *defines)
+{
+  GLint vertexLength, fragmentLength;
+  GLchar *vertexSource = preprocess_shader(vertexFile, defines, &vertexLength);
+  GLchar *fragmentSource = preprocess_shader(fragmentFile, defines, &fragmentLength);
+  GLuint shaderProgram = 0;
+
+  if(vertexSource && fragmentSource)
+    shaderProgram = program_from_sources(vertexSource, vertexLength, vertexFile,
+                                         fragmentSource, fragmentLength, fragmentFile);
+
+  free(vertexSource);
+  free(fragmentSource);
+  return shaderProgram;
+}
+
+// Builds a program from in-memory sources, going through the binary cache.
+GLuint program_from_sources(const GLchar *vertexSource, GLint vertexLength, const char *vertexName,
+                            const GLchar *fragmentSource, GLint fragmentLength, const char *fragmentName)
+{
+  GLuint shaderProgram = 0;
+  shader_source sources[2] = {
+    { vertexSource, vertexLength },
+    { fragmentSource, fragmentLength }
+  };
+
+  shaderProgram = shader_cache_load(sources, 2);
+  if(!shaderProgram) {
+    double compileStart = glfwGetTime();
+    GLuint vertexShader = compile_shader(GL_VERTEX_SHADER, vertexSource, vertexLength, vertexName);
+    GLuint fragmentShader = compile_shader(GL_FRAGMENT_SHADER, fragmentSource, fragmentLength, fragmentName);
+    if(vertexShader && fragmentShader)
+      shaderProgram = make_program(vertexShader, fragmentShader);
+    else {
+      glDeleteShader(vertexShader);
+      glDeleteShader(fragmentShader);
+    }
+    if(shaderProgram)
+      shader_cache_store(sources, 2, shaderProgram, glfwGetTime() - compileStart);
+  }
+  return shaderProgram;
+}
+
+GLuint make_shader(GLenum type, const char *filename)
+{
+  vfs_file file;
+  GLuint shader;
+
+  if(!vfs_open(filename, &file)) {
+    fprintf(stderr, "Unable to open %s for reading\n", filename);
+    return 0;
+  }
+  shader = compile_shader(type, file.data, file.size, filename);
+  vfs_close(&file);
+  return shader;
+}
+
+GLuint compile_shader(GLenum type, const GLchar *source, GLint length, const char *name)
+{
+  GLuint shader;
+  GLint shader_ok;
+
+  shader = glCreateShader(type);
+  glShaderSource(shader, 1, &source, &length);
+  glCompileShader(shader);
+
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &shader_ok);
+  if(!shader_ok) {
+    fprintf(stderr, "Failed to compile %s: \n", name);
+    show_info_log(shader);
+    glDeleteShader(shader);
+    return 0;
+  }
+  return shader;
+}
+
+void show_info_log(GLuint object)
+{
+  GLint log_length;
+  char *log;
+
+  glGetShaderiv(object, GL_INFO_LOG_LENGTH, &log_length);
+  log = (char*)malloc(log_length);
+  glGetShaderInfoLog(object, log_length, NULL, log);
+  fprintf(stderr, "%s", log);
+  free(log); 
+}
+
+void show_program_log(GLuint program)
+{
+  GLint log_length;
+  char *log;
+
+  glGetProgramiv(program, GL_INFO_LOG_LENGTH, &log_length);
+  if(log_length <= 0) return;
+  log = (char*)malloc(log_length);
+  glGetProgramInfoLog(program, log_length, NULL, log);
+  fprintf(stderr, "%s", log);
+  free(log);
+}
+
+// Links and consumes both shaders. Returns 0 if linking fails.
+GLuint make_program(GLuint vertex_shader, GLuint fragment_shader)
+{
+  GLint program_ok;
+  GLuint program = glCreateProgram();
+
+  shader_cache_prepare(program);
+  glAttachShader(program, vertex_shader);
+  glAttachShader(program, fragment_shader);
+  glLinkProgram(program);
+
+  glDetachShader(program, vertex_shader);
+  glDetachShader(program, fragment_shader);
+  glDeleteShader(vertex_shader);
+  glDeleteShader(fragment_shader);
+
+  glGetProgramiv(program, GL_LINK_STATUS, &program_ok);
+  if(!program_ok) {
+    fprintf(stderr, "Failed to link shader program:\n");
+    show_program_log(program);
+    glDeleteProgram(program);
+    return 0;
+  }
+  return program;
+}
@@ -0,0 +1,16 @@
+#ifndef SHADER_H
+#define SHADER_H
+
+#include <glad/glad.h>
+
+GLuint getShaderProgram(const char *vertexFile, const char *fragmentFile);
+GLuint getShaderVariant(const char *vertexFile, const char *fragmentFile, const char *defines);
+GLuint program_from_sources(const GLchar *vertexSource, GLint vertexLength, const char *vertexName,
+                            const GLchar *fragmentSource, GLint fragmentLength, const char *fragmentName);
+GLuint make_shader(GLenum type, const char *filename);
+GLuint compile_shader(GLenum type, const GLchar *source, GLint length, const char *name);
+GLuint make_program(GLuint vertex_shader, GLuint fragment_shader);
+void show_info_log(GLuint object);
+void show_program_log(GLuint program);
+
+#endif
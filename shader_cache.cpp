@@ -0,0 +1,186 @@
+#include "shader_cache.h"
+#include <GLFW/glfw3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+
+#define SHADER_CACHE_MAGIC 0x31534247 /* "GBS1" */
+
+typedef void (APIENTRYP get_program_binary_proc)(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary);
+typedef void (APIENTRYP program_binary_proc)(GLuint program, GLenum binaryFormat, const void *binary, GLsizei length);
+typedef void (APIENTRYP program_parameteri_proc)(GLuint program, GLenum pname, GLint value);
+
+struct shader_cache_header {
+  unsigned int magic;
+  unsigned int format;
+  unsigned long long source_hash;
+  unsigned long long driver_hash;
+  double compile_seconds;
+  unsigned int length;
+  unsigned int pad;
+};
+
+static int cache_state = -1;
+static get_program_binary_proc get_program_binary;
+static program_binary_proc program_binary;
+static program_parameteri_proc program_parameteri;
+
+unsigned long long hash_bytes(const void *data, size_t length, unsigned long long seed) {
+  const unsigned char *p = (const unsigned char *)data;
+  unsigned long long h = seed ? seed : 14695981039346656037ULL;
+  for(size_t i=0;i<length;i++) {
+    h ^= p[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+static unsigned long long source_hash(const shader_source *sources, int count) {
+  unsigned long long h = 0;
+  for(int i=0;i<count;i++) {
+    h = hash_bytes(sources[i].text, sources[i].length, h);
+    h = hash_bytes("\0", 1, h);
+  }
+  return h;
+}
+
+static unsigned long long driver_hash() {
+  const char *vendor = (const char *)glGetString(GL_VENDOR);
+  const char *renderer = (const char *)glGetString(GL_RENDERER);
+  const char *version = (const char *)glGetString(GL_VERSION);
+  unsigned long long h = 0;
+  if(vendor) h = hash_bytes(vendor, strlen(vendor), h);
+  if(renderer) h = hash_bytes(renderer, strlen(renderer), h);
+  if(version) h = hash_bytes(version, strlen(version), h);
+  return h;
+}
+
+static void cache_path(char *path, size_t size, unsigned long long hash) {
+  snprintf(path, size, "%s/%016llx.bin", SHADER_CACHE_DIR, hash);
+}
+
+int shader_cache_available() {
+  if(cache_state >= 0)
+    return cache_state;
+
+  cache_state = 0;
+  if(!glfwExtensionSupported("GL_ARB_get_program_binary"))
+    return 0;
+
+  get_program_binary = (get_program_binary_proc)glfwGetProcAddress("glGetProgramBinary");
+  program_binary = (program_binary_proc)glfwGetProcAddress("glProgramBinary");
+  program_parameteri = (program_parameteri_proc)glfwGetProcAddress("glProgramParameteri");
+
+  GLint formats = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+  if(get_program_binary && program_binary && program_parameteri && formats > 0)
+    cache_state = 1;
+  return cache_state;
+}
+
+void shader_cache_prepare(GLuint program) {
+  if(shader_cache_available())
+    program_parameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+GLuint shader_cache_load(const shader_source *sources, int count) {
+  if(!shader_cache_available())
+    return 0;
+
+  double start = glfwGetTime();
+  unsigned long long hash = source_hash(sources, count);
+  char path[256];
+  cache_path(path, sizeof(path), hash);
+
+  FILE *f = fopen(path, "rb");
+  if(!f) {
+    fprintf(stderr, "shader cache: miss %016llx\n", hash);
+    return 0;
+  }
+
+  shader_cache_header header;
+  void *binary = NULL;
+  GLuint program = 0;
+  GLint program_ok = 0;
+
+  if(fread(&header, sizeof(header), 1, f) != 1 || header.magic != SHADER_CACHE_MAGIC ||
+     header.source_hash != hash || header.driver_hash != driver_hash()) {
+    fprintf(stderr, "shader cache: stale entry %016llx\n", hash);
+    fclose(f);
+    return 0;
+  }
+
+  binary = malloc(header.length);
+  if(fread(binary, 1, header.length, f) != header.length) {
+    fprintf(stderr, "shader cache: truncated entry %016llx\n", hash);
+    free(binary);
+    fclose(f);
+    return 0;
+  }
+  fclose(f);
+
+  // The driver may still reject a binary it produced, e.g. after an
+  // update that kept the version string. Fall back to source then.
+  program = glCreateProgram();
+  program_parameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  program_binary(program, header.format, binary, header.length);
+  free(binary);
+
+  glGetProgramiv(program, GL_LINK_STATUS, &program_ok);
+  if(!program_ok) {
+    fprintf(stderr, "shader cache: driver rejected entry %016llx\n", hash);
+    glDeleteProgram(program);
+    return 0;
+  }
+
+  double elapsed = glfwGetTime() - start;
+  fprintf(stderr, "shader cache: hit %016llx in %.2f ms, saved %.2f ms\n",
+          hash, elapsed*1000, (header.compile_seconds - elapsed)*1000);
+  return program;
+}
+
+void shader_cache_store(const shader_source *sources, int count, GLuint program, double compile_seconds) {
+  if(!shader_cache_available())
+    return;
+
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if(length <= 0)
+    return;
+
+  shader_cache_header header;
+  void *binary = malloc(length);
+  GLsizei written = 0;
+  GLenum format = 0;
+  get_program_binary(program, length, &written, &format, binary);
+
+  header.magic = SHADER_CACHE_MAGIC;
+  header.format = format;
+  header.source_hash = source_hash(sources, count);
+  header.driver_hash = driver_hash();
+  header.compile_seconds = compile_seconds;
+  header.length = written;
+  header.pad = 0;
+
+  mkdir(SHADER_CACHE_DIR, 0755);
+  char path[256];
+  cache_path(path, sizeof(path), header.source_hash);
+  FILE *f = fopen(path, "wb");
+  if(!f) {
+    fprintf(stderr, "shader cache: unable to write %s\n", path);
+    free(binary);
+    return;
+  }
+  fwrite(&header, sizeof(header), 1, f);
+  fwrite(binary, 1, written, f);
+  fclose(f);
+  free(binary);
+
+  fprintf(stderr, "shader cache: stored %016llx (%d bytes, compile took %.2f ms)\n",
+          header.source_hash, written, compile_seconds*1000);
+}
@@ -0,0 +1,25 @@
+#ifndef SHADER_CACHE_H
+#define SHADER_CACHE_H
+
+#include <glad/glad.h>
+#include <stddef.h>
+
+#define SHADER_CACHE_DIR "shader_cache"
+
+struct shader_source {
+  const GLchar *text;
+  GLint length;
+};
+
+// On-disk cache of linked program binaries (GL_ARB_get_program_binary).
+// Entries are keyed on the hash of all stage sources; the driver vendor,
+// renderer and version are stored alongside and must match on load.
+// Every function is a no-op when the extension is missing.
+int shader_cache_available();
+void shader_cache_prepare(GLuint program);
+GLuint shader_cache_load(const shader_source *sources, int count);
+void shader_cache_store(const shader_source *sources, int count, GLuint program, double compile_seconds);
+
+unsigned long long hash_bytes(const void *data, size_t length, unsigned long long seed);
+
+#endif
@@ -0,0 +1,252 @@
+#include "shader_reload.h"
+#include "shader.h"
+#include "shader_cache.h"
+#include "shader_variant.h"
+#include <GLFW/glfw3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/inotify.h>
+
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+
+typedef void (APIENTRYP max_shader_compiler_threads_proc)(GLuint count);
+
+static int parallel_compile = -1;
+
+static int parallel_compile_available() {
+  if(parallel_compile >= 0)
+    return parallel_compile;
+
+  parallel_compile = 0;
+  if(glfwExtensionSupported("GL_KHR_parallel_shader_compile")) {
+    max_shader_compiler_threads_proc max_threads =
+      (max_shader_compiler_threads_proc)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+    if(max_threads)
+      max_threads(0xFFFFFFFFu);
+    parallel_compile = 1;
+  }
+  return parallel_compile;
+}
+
+static const char *base_name(const char *path) {
+  const char *slash = strrchr(path, '/');
+  return slash ? slash + 1 : path;
+}
+
+static int is_watched(shader_reloader *r, const char *name) {
+  if(!strcmp(name, base_name(r->vertex_file)) || !strcmp(name, base_name(r->fragment_file)))
+    return 1;
+  std::lock_guard<std::mutex> lock(r->includes_lock);
+  for(int i=0;i<r->includes.count;i++)
+    if(!strcmp(name, base_name(r->includes.paths[i])))
+      return 1;
+  return 0;
+}
+
+static void watch_files(shader_reloader *r) {
+  char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  struct pollfd pfd;
+  pfd.fd = r->inotify_fd;
+  pfd.events = POLLIN;
+
+  while(r->running) {
+    // Time out periodically so shader_reload_stop can join us.
+    if(poll(&pfd, 1, 250) <= 0)
+      continue;
+
+    ssize_t n = read(r->inotify_fd, buffer, sizeof(buffer));
+    if(n <= 0)
+      continue;
+
+    for(char *p = buffer; p < buffer + n; ) {
+      struct inotify_event *e = (struct inotify_event *)p;
+      if(e->len && is_watched(r, e->name)) {
+        r->changed = 1;
+        glfwPostEmptyEvent();
+      }
+      p += sizeof(struct inotify_event) + e->len;
+    }
+  }
+}
+
+static void add_watch_dir(shader_reloader *r, const char *file) {
+  char dir[512];
+  const char *slash = strrchr(file, '/');
+  if(slash) {
+    snprintf(dir, sizeof(dir), "%.*s", (int)(slash - file), file);
+  } else {
+    strcpy(dir, ".");
+  }
+  // Watch the directory, not the file: editors usually save by writing a
+  // temporary and renaming it over the original.
+  inotify_add_watch(r->inotify_fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+}
+
+// Takes ownership of a fresh include list, watching any new directories.
+static void watch_includes(shader_reloader *r, shader_include_list *includes) {
+  if(r->inotify_fd >= 0)
+    for(int i=0;i<includes->count;i++)
+      add_watch_dir(r, includes->paths[i]);
+  std::lock_guard<std::mutex> lock(r->includes_lock);
+  free_shader_include_list(&r->includes);
+  r->includes = *includes;
+}
+
+int shader_reload_start(shader_reloader *r, const char *vertexFile, const char *fragmentFile) {
+  r->vertex_file = vertexFile;
+  r->fragment_file = fragmentFile;
+  r->defines = NULL;
+  r->changed = 0;
+  r->pending_program = 0;
+  r->pending_vertex = 0;
+  r->pending_fragment = 0;
+  r->pending_vertex_source = NULL;
+  r->pending_fragment_source = NULL;
+  r->pending_started = 0;
+  r->includes = shader_include_list();
+
+  r->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if(r->inotify_fd < 0) {
+    fprintf(stderr, "shader reload: inotify unavailable, hot reload disabled\n");
+    r->running = 0;
+    return 0;
+  }
+  add_watch_dir(r, vertexFile);
+  add_watch_dir(r, fragmentFile);
+
+  // The program was built elsewhere, so preprocess once here to learn
+  // which files it includes.
+  shader_include_list includes = {};
+  GLint length;
+  free(preprocess_shader_tracked(vertexFile, NULL, &length, &includes));
+  free(preprocess_shader_tracked(fragmentFile, NULL, &length, &includes));
+  watch_includes(r, &includes);
+
+  r->running = 1;
+  r->watcher = std::thread(watch_files, r);
+  return 1;
+}
+
+static void discard_pending(shader_reloader *r) {
+  if(r->pending_vertex) glDeleteShader(r->pending_vertex);
+  if(r->pending_fragment) glDeleteShader(r->pending_fragment);
+  if(r->pending_program) glDeleteProgram(r->pending_program);
+  r->pending_program = r->pending_vertex = r->pending_fragment = 0;
+  free(r->pending_vertex_source);
+  free(r->pending_fragment_source);
+  r->pending_vertex_source = r->pending_fragment_source = NULL;
+}
+
+static void begin_relink(shader_reloader *r) {
+  GLint vertexLength, fragmentLength;
+  shader_include_list includes = {};
+  GLchar *vertexSource = preprocess_shader_tracked(r->vertex_file, r->defines, &vertexLength, &includes);
+  GLchar *fragmentSource = preprocess_shader_tracked(r->fragment_file, r->defines, &fragmentLength, &includes);
+
+  if(!vertexSource || !fragmentSource) {
+    free_shader_include_list(&includes);
+    free(vertexSource);
+    free(fragmentSource);
+    return;
+  }
+  watch_includes(r, &includes);
+
+  discard_pending(r);
+  parallel_compile_available();
+
+  // Issue compile and link without querying status in between; with
+  // parallel compile the driver finishes this on its own threads.
+  r->pending_vertex = glCreateShader(GL_VERTEX_SHADER);
+  glShaderSource(r->pending_vertex, 1, (const GLchar **)&vertexSource, &vertexLength);
+  glCompileShader(r->pending_vertex);
+
+  r->pending_fragment = glCreateShader(GL_FRAGMENT_SHADER);
+  glShaderSource(r->pending_fragment, 1, (const GLchar **)&fragmentSource, &fragmentLength);
+  glCompileShader(r->pending_fragment);
+
+  r->pending_program = glCreateProgram();
+  shader_cache_prepare(r->pending_program);
+  glAttachShader(r->pending_program, r->pending_vertex);
+  glAttachShader(r->pending_program, r->pending_fragment);
+  glLinkProgram(r->pending_program);
+  r->pending_started = glfwGetTime();
+
+  r->pending_vertex_source = vertexSource;
+  r->pending_fragment_source = fragmentSource;
+  r->pending_vertex_length = vertexLength;
+  r->pending_fragment_length = fragmentLength;
+}
+
+static void finish_relink(shader_reloader *r, GLuint *program) {
+  GLint program_ok, shader_ok;
+
+  glGetProgramiv(r->pending_program, GL_LINK_STATUS, &program_ok);
+  if(!program_ok) {
+    glGetShaderiv(r->pending_vertex, GL_COMPILE_STATUS, &shader_ok);
+    if(!shader_ok) {
+      fprintf(stderr, "Failed to compile %s: \n", r->vertex_file);
+      show_info_log(r->pending_vertex);
+    }
+    glGetShaderiv(r->pending_fragment, GL_COMPILE_STATUS, &shader_ok);
+    if(!shader_ok) {
+      fprintf(stderr, "Failed to compile %s: \n", r->fragment_file);
+      show_info_log(r->pending_fragment);
+    }
+    show_program_log(r->pending_program);
+    fprintf(stderr, "shader reload: keeping previous program\n");
+    discard_pending(r);
+    return;
+  }
+
+  shader_source sources[2] = {
+    { r->pending_vertex_source, r->pending_vertex_length },
+    { r->pending_fragment_source, r->pending_fragment_length }
+  };
+  shader_cache_store(sources, 2, r->pending_program, glfwGetTime() - r->pending_started);
+
+  glDetachShader(r->pending_program, r->pending_vertex);
+  glDetachShader(r->pending_program, r->pending_fragment);
+
+  // Hand the program over before discarding the rest of the relink.
+  *program = r->pending_program;
+  r->pending_program = 0;
+  discard_pending(r);
+  fprintf(stderr, "shader reload: relinked %s + %s\n", r->vertex_file, r->fragment_file);
+}
+
+// Call once per frame on the GL thread. Returns 1 when a relinked program
+// was stored in *program; the caller owns it and must dispose of the one
+// it replaces.
+int shader_reload_poll(shader_reloader *r, GLuint *program) {
+  if(r->changed.exchange(0))
+    begin_relink(r);
+
+  if(!r->pending_program)
+    return 0;
+
+  if(parallel_compile_available()) {
+    GLint done = GL_FALSE;
+    glGetProgramiv(r->pending_program, GL_COMPLETION_STATUS_KHR, &done);
+    if(!done)
+      return 0;
+  }
+
+  GLuint before = *program;
+  finish_relink(r, program);
+  return *program != before;
+}
+
+void shader_reload_stop(shader_reloader *r) {
+  if(r->running) {
+    r->running = 0;
+    r->watcher.join();
+  }
+  if(r->inotify_fd >= 0)
+    close(r->inotify_fd);
+  r->inotify_fd = -1;
+  discard_pending(r);
+  free_shader_include_list(&r->includes);
+}
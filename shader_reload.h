@@ -0,0 +1,45 @@
+#ifndef SHADER_RELOAD_H
+#define SHADER_RELOAD_H
+
+#include <glad/glad.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include "shader_variant.h"
+
+// Watches a vertex/fragment pair and the files they #include with inotify
+// on a background thread and relinks on the GL thread when any changes.
+// A new program only replaces the live one once it has linked, so a typo
+// in the shader keeps the old program running.
+struct shader_reloader {
+  const char *vertex_file;
+  const char *fragment_file;
+  const char *defines;
+
+  int inotify_fd;
+  // Includes found the last time the pair preprocessed; the watcher reads
+  // them under the lock while the GL thread replaces them.
+  std::mutex includes_lock;
+  shader_include_list includes;
+  std::atomic<int> changed;
+  std::atomic<int> running;
+  std::thread watcher;
+
+  // In-flight relink, polled with GL_COMPLETION_STATUS_KHR when the driver
+  // compiles in parallel. The sources it was built from are kept to key
+  // the shader cache, since the files may be saved again before it links.
+  GLuint pending_program;
+  GLuint pending_vertex;
+  GLuint pending_fragment;
+  GLchar *pending_vertex_source;
+  GLchar *pending_fragment_source;
+  GLint pending_vertex_length;
+  GLint pending_fragment_length;
+  double pending_started;
+};
+
+int shader_reload_start(shader_reloader *r, const char *vertexFile, const char *fragmentFile);
+int shader_reload_poll(shader_reloader *r, GLuint *program);
+void shader_reload_stop(shader_reloader *r);
+
+#endif
@@ -0,0 +1,187 @@
+#include "shader_variant.h"
+#include "vfs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+struct text_buffer {
+  char *data;
+  int length, capacity;
+};
+
+static void text_append(text_buffer *b, const char *text, int length) {
+  if(b->length + length + 1 > b->capacity) {
+    int capacity = b->capacity ? b->capacity : 1024;
+    while(b->length + length + 1 > capacity)
+      capacity *= 2;
+    b->data = (char *)realloc(b->data, capacity);
+    b->capacity = capacity;
+  }
+  memcpy(b->data + b->length, text, length);
+  b->length += length;
+  b->data[b->length] = '\0';
+}
+
+static void text_printf(text_buffer *b, const char *format, ...) {
+  char line[512];
+  va_list args;
+  va_start(args, format);
+  int n = vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  text_append(b, line, n < (int)sizeof(line) ? n : (int)sizeof(line) - 1);
+}
+
+static int compare_strings(const void *a, const void *b) {
+  return strcmp(*(const char **)a, *(const char **)b);
+}
+
+// Splits on spaces/commas, sorts and rejoins with ',' so that
+// "B A" and "A,B" name the same variant.
+char *normalize_defines(const char *defines) {
+  if(!defines)
+    defines = "";
+
+  char *copy = strdup(defines);
+  const char *tokens[64];
+  int count = 0;
+  for(char *t = strtok(copy, " ,\t\n"); t && count < 64; t = strtok(NULL, " ,\t\n"))
+    tokens[count++] = t;
+  qsort(tokens, count, sizeof(tokens[0]), compare_strings);
+
+  text_buffer key = { NULL, 0, 0 };
+  text_append(&key, "", 0);
+  for(int i=0;i<count;i++) {
+    if(i > 0 && !strcmp(tokens[i], tokens[i-1]))
+      continue;
+    if(key.length)
+      text_append(&key, ",", 1);
+    text_append(&key, tokens[i], strlen(tokens[i]));
+  }
+  free(copy);
+  return key.data;
+}
+
+static void append_defines(text_buffer *out, const char *key) {
+  char *copy = strdup(key);
+  for(char *t = strtok(copy, ","); t; t = strtok(NULL, ",")) {
+    char *eq = strchr(t, '=');
+    if(eq) {
+      *eq = '\0';
+      text_printf(out, "#define %s %s\n", t, eq + 1);
+    } else {
+      text_printf(out, "#define %s 1\n", t);
+    }
+  }
+  free(copy);
+}
+
+static void add_include(shader_include_list *l, const char *path) {
+  for(int i=0;i<l->count;i++)
+    if(!strcmp(l->paths[i], path))
+      return;
+  if(l->count == l->capacity) {
+    l->capacity = l->capacity ? l->capacity * 2 : 8;
+    l->paths = (char **)realloc(l->paths, l->capacity * sizeof(char *));
+  }
+  l->paths[l->count++] = strdup(path);
+}
+
+void free_shader_include_list(shader_include_list *l) {
+  for(int i=0;i<l->count;i++)
+    free(l->paths[i]);
+  free(l->paths);
+  l->paths = NULL;
+  l->count = l->capacity = 0;
+}
+
+static int append_file(text_buffer *out, const char *filename, const char *defines, int depth,
+                       shader_include_list *includes) {
+  if(depth > SHADER_MAX_INCLUDE_DEPTH) {
+    fprintf(stderr, "Include depth exceeded at %s\n", filename);
+    return 0;
+  }
+
+  vfs_file file;
+  int opened = includes ? vfs_open_loose(filename, &file) : vfs_open(filename, &file);
+  if(!opened) {
+    fprintf(stderr, "Unable to open %s for reading\n", filename);
+    return 0;
+  }
+  const char *source = file.data, *source_end = file.data + file.size;
+
+  char dir[512] = "";
+  const char *slash = strrchr(filename, '/');
+  if(slash)
+    snprintf(dir, sizeof(dir), "%.*s", (int)(slash - filename + 1), filename);
+
+  int ok = 1;
+  int line_number = 1;
+  const char *line = source;
+  while(ok && line < source_end) {
+    const char *end = (const char *)memchr(line, '\n', source_end - line);
+    int line_length = end ? (int)(end - line) + 1 : (int)(source_end - line);
+    const char *line_end = line + line_length;
+    const char *p = line;
+    while(p < line_end && (*p == ' ' || *p == '\t')) p++;
+
+    if(line_end - p >= 8 && !strncmp(p, "#version", 8)) {
+      // Only the outermost file keeps its #version; defines go right
+      // after it since GLSL requires #version to come first.
+      if(depth == 0) {
+        text_append(out, line, line_length);
+        if(!end) text_append(out, "\n", 1);
+        if(defines)
+          append_defines(out, defines);
+        text_printf(out, "#line %d\n", line_number + 1);
+      }
+    } else if(line_end - p >= 8 && !strncmp(p, "#include", 8)) {
+      const char *open = (const char *)memchr(p, '"', line_end - p);
+      const char *close = open ? (const char *)memchr(open + 1, '"', line_end - open - 1) : NULL;
+      if(!open || !close) {
+        fprintf(stderr, "%s:%d: malformed #include\n", filename, line_number);
+        ok = 0;
+        break;
+      }
+      char path[1024];
+      snprintf(path, sizeof(path), "%s%.*s", dir, (int)(close - open - 1), open + 1);
+      if(includes)
+        add_include(includes, path);
+      // Number the included lines from 1, then resume the parent's count.
+      text_printf(out, "#line 1\n");
+      ok = append_file(out, path, NULL, depth + 1, includes);
+      text_printf(out, "#line %d\n", line_number + 1);
+    } else {
+      text_append(out, line, line_length);
+    }
+
+    line_number++;
+    line += line_length;
+  }
+
+  vfs_close(&file);
+  return ok;
+}
+
+// Reads a shader, resolves #include "file" relative to the including file
+// and injects '#define NAME VALUE' lines for each define after #version.
+GLchar *preprocess_shader(const char *filename, const char *defines, GLint *length) {
+  return preprocess_shader_tracked(filename, defines, length, NULL);
+}
+
+// As preprocess_shader, also adding every included path to *includes.
+// Loose files in the working directory win over packed or built-in ones.
+GLchar *preprocess_shader_tracked(const char *filename, const char *defines, GLint *length,
+                                  shader_include_list *includes) {
+  text_buffer out = { NULL, 0, 0 };
+  char *key = normalize_defines(defines);
+
+  int ok = append_file(&out, filename, key, 0, includes);
+  free(key);
+  if(!ok) {
+    free(out.data);
+    return NULL;
+  }
+  *length = out.length;
+  return out.data;
+}
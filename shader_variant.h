@@ -0,0 +1,21 @@
+#ifndef SHADER_VARIANT_H
+#define SHADER_VARIANT_H
+
+#include <glad/glad.h>
+
+#define SHADER_MAX_INCLUDE_DEPTH 16
+
+// Paths pulled in through #include while preprocessing, each listed once,
+// so the hot reloader can watch them alongside the top-level files.
+struct shader_include_list {
+  char **paths;
+  int count, capacity;
+};
+
+char *normalize_defines(const char *defines);
+GLchar *preprocess_shader(const char *filename, const char *defines, GLint *length);
+GLchar *preprocess_shader_tracked(const char *filename, const char *defines, GLint *length,
+                                  shader_include_list *includes);
+void free_shader_include_list(shader_include_list *l);
+
+#endif
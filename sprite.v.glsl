@@ -0,0 +1,18 @@
+#version 330 core
+layout (location = 0) in vec4 aRect;
+layout (location = 1) in vec4 aUV;
+layout (location = 2) in vec4 aColor;
+
+#include "uniforms.glsl"
+
+out vec4 vertexColor;
+out vec2 texCoord;
+
+void main()
+{
+  // Triangle strip corners (0,0) (1,0) (0,1) (1,1).
+  vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+  gl_Position = view * vec4(aRect.xy + corner*aRect.zw, 0.0, 1.0);
+  vertexColor = aColor;
+  texCoord = mix(aUV.xy, aUV.zw, corner);
+}
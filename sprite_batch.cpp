@@ -0,0 +1,108 @@
+#include "sprite_batch.h"
+#include "gl_state.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+// The streamed buffer holds this many batches' worth of instances before
+// it is orphaned.
+#define SPRITE_STREAM_BATCHES 4
+
+static void set_instance_pointers(GLintptr base) {
+  GLsizei stride = sizeof(sprite_instance);
+  glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, stride, (void *)(base + offsetof(sprite_instance, x)));
+  glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, stride, (void *)(base + offsetof(sprite_instance, u0)));
+  glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void *)(base + offsetof(sprite_instance, r)));
+}
+
+int sprite_batch_init(sprite_batch *b, int capacity) {
+  b->capacity = capacity;
+  b->count = 0;
+  b->staging = (sprite_instance *)malloc(capacity * sizeof(sprite_instance));
+  b->buffer_size = capacity * sizeof(sprite_instance) * SPRITE_STREAM_BATCHES;
+  b->write_offset = 0;
+  b->program = 0;
+  b->texture = 0;
+  b->draws = 0;
+  b->sprites = 0;
+
+  // No per-vertex data: sprite.v.glsl derives the quad corner from
+  // gl_VertexID, so the only buffer is the per-instance one.
+  glGenVertexArrays(1, &b->vao);
+  state_bind_vertex_array(b->vao);
+  glGenBuffers(1, &b->instance_buffer);
+  state_bind_buffer(GL_ARRAY_BUFFER, b->instance_buffer);
+  glBufferData(GL_ARRAY_BUFFER, b->buffer_size, NULL, GL_STREAM_DRAW);
+
+  for(int i=0;i<3;i++) {
+    glEnableVertexAttribArray(i);
+    glVertexAttribDivisor(i, 1);
+  }
+  set_instance_pointers(0);
+  state_bind_vertex_array(0);
+
+  return b->staging != NULL;
+}
+
+void sprite_batch_begin(sprite_batch *b) {
+  b->count = 0;
+  b->program = 0;
+  b->texture = 0;
+  b->draws = 0;
+  b->sprites = 0;
+}
+
+void sprite_batch_draw(sprite_batch *b, GLuint program, GLuint texture, const sprite_instance &s) {
+  if(b->count > 0 && (program != b->program || texture != b->texture || b->count == b->capacity))
+    sprite_batch_flush(b);
+  b->program = program;
+  b->texture = texture;
+  b->staging[b->count++] = s;
+}
+
+void sprite_batch_flush(sprite_batch *b) {
+  if(b->count == 0)
+    return;
+
+  GLsizeiptr bytes = b->count * sizeof(sprite_instance);
+  state_bind_buffer(GL_ARRAY_BUFFER, b->instance_buffer);
+  if(b->write_offset + bytes > b->buffer_size) {
+    // Orphan: the driver hands us fresh storage while in-flight draws
+    // keep reading the old one.
+    glBufferData(GL_ARRAY_BUFFER, b->buffer_size, NULL, GL_STREAM_DRAW);
+    b->write_offset = 0;
+  }
+
+  void *dst = glMapBufferRange(GL_ARRAY_BUFFER, b->write_offset, bytes,
+                               GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+  if(dst) {
+    memcpy(dst, b->staging, bytes);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+  } else {
+    glBufferSubData(GL_ARRAY_BUFFER, b->write_offset, bytes, b->staging);
+  }
+
+  state_bind_vertex_array(b->vao);
+  set_instance_pointers(b->write_offset);
+  state_use_program(b->program);
+  state_bind_texture(0, GL_TEXTURE_2D, b->texture);
+  glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, b->count);
+
+  b->write_offset += bytes;
+  b->draws++;
+  b->sprites += b->count;
+  b->count = 0;
+}
+
+void sprite_batch_end(sprite_batch *b) {
+  sprite_batch_flush(b);
+}
+
+void sprite_batch_destroy(sprite_batch *b) {
+  state_forget_vertex_array(b->vao);
+  state_forget_buffer(b->instance_buffer);
+  glDeleteVertexArrays(1, &b->vao);
+  glDeleteBuffers(1, &b->instance_buffer);
+  free(b->staging);
+  b->staging = NULL;
+}
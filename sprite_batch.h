@@ -0,0 +1,40 @@
+#ifndef SPRITE_BATCH_H
+#define SPRITE_BATCH_H
+
+#include <glad/glad.h>
+
+// Per-sprite data streamed to the GPU; one instance per quad.
+struct sprite_instance {
+  float x, y, w, h;
+  float u0, v0, u1, v1;
+  unsigned char r, g, b, a;
+};
+
+// Collects sprites and draws each run that shares a program and texture
+// with a single glDrawArraysInstanced. Instance data is appended to a
+// streamed buffer with unsynchronized maps and orphaned when full, so the
+// CPU never waits on the GPU for buffer space.
+struct sprite_batch {
+  GLuint vao;
+  GLuint instance_buffer;
+  GLsizeiptr buffer_size;
+  GLintptr write_offset;
+
+  sprite_instance *staging;
+  int count, capacity;
+
+  GLuint program;
+  GLuint texture;
+
+  int draws;
+  int sprites;
+};
+
+int sprite_batch_init(sprite_batch *b, int capacity);
+void sprite_batch_begin(sprite_batch *b);
+void sprite_batch_draw(sprite_batch *b, GLuint program, GLuint texture, const sprite_instance &s);
+void sprite_batch_flush(sprite_batch *b);
+void sprite_batch_end(sprite_batch *b);
+void sprite_batch_destroy(sprite_batch *b);
+
+#endif
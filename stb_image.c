@@ -1,2 +1,6 @@
+#include "image_arena.h"
+#define STBI_MALLOC(sz) image_arena_malloc(sz)
+#define STBI_REALLOC(p,newsz) image_arena_realloc(p,newsz)
+#define STBI_FREE(p) image_arena_free(p)
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -0,0 +1,203 @@
+// Offline texture converter: decodes an image with stb_image, bakes its
+// mip chain and writes the aligned container that load_texture_file maps.
+//
+//   ./texconv [--bgra | --bc1 | --bc3] [--no-mips] input.jpg output.tex
+//   ./texconv --virtual input.jpg output.vtex
+
+#include "texture_file.h"
+#include "bc_encode.h"
+#include "stb_image.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct image_level {
+  int width, height;
+  unsigned char *pixels;
+  size_t size;
+};
+
+// 2x2 box filter. Odd edges repeat their last row or column so a 5x3
+// level still averages every source texel into a 2x1 one.
+static image_level downsample(const image_level *src) {
+  image_level dst;
+  dst.width = src->width > 1 ? src->width / 2 : 1;
+  dst.height = src->height > 1 ? src->height / 2 : 1;
+  dst.size = (size_t)dst.width * dst.height * 4;
+  dst.pixels = (unsigned char *)malloc(dst.size);
+
+  for(int y=0;y<dst.height;y++) {
+    int y0 = y*2, y1 = y*2 + 1 < src->height ? y*2 + 1 : y*2;
+    for(int x=0;x<dst.width;x++) {
+      int x0 = x*2, x1 = x*2 + 1 < src->width ? x*2 + 1 : x*2;
+      const unsigned char *a = src->pixels + ((size_t)y0*src->width + x0)*4;
+      const unsigned char *b = src->pixels + ((size_t)y0*src->width + x1)*4;
+      const unsigned char *c = src->pixels + ((size_t)y1*src->width + x0)*4;
+      const unsigned char *d = src->pixels + ((size_t)y1*src->width + x1)*4;
+      unsigned char *out = dst.pixels + ((size_t)y*dst.width + x)*4;
+      for(int k=0;k<4;k++)
+        out[k] = (a[k] + b[k] + c[k] + d[k] + 2) >> 2;
+    }
+  }
+  return dst;
+}
+
+static void swizzle_bgra(image_level *level) {
+  for(size_t i=0;i<level->size;i+=4) {
+    unsigned char t = level->pixels[i];
+    level->pixels[i] = level->pixels[i+2];
+    level->pixels[i+2] = t;
+  }
+}
+
+// Replaces a level's RGBA pixels with BC1 or BC3 blocks.
+static void compress_level(image_level *level, int format, int first) {
+  int block_bytes = format == TEXTURE_FORMAT_BC1 ? BC1_BLOCK_BYTES : BC3_BLOCK_BYTES;
+  size_t size = bc_image_size(level->width, level->height, block_bytes);
+  unsigned char *blocks = (unsigned char *)malloc(size);
+  if(format == TEXTURE_FORMAT_BC1)
+    encode_bc1_image(level->pixels, level->width, level->height, 4, blocks, BC_QUALITY);
+  else
+    encode_bc3_image(level->pixels, level->width, level->height, 4, blocks, BC_QUALITY);
+  if(first)
+    stbi_image_free(level->pixels);
+  else
+    free(level->pixels);
+  level->pixels = blocks;
+  level->size = size;
+}
+
+// Cuts one level into bordered pages. Border texels past the image edge
+// repeat the edge, matching GL_CLAMP_TO_EDGE.
+static int write_virtual_level(FILE *f, const image_level *level, unsigned char *page) {
+  int pages_x = (level->width + VIRTUAL_PAGE_SIZE - 1) / VIRTUAL_PAGE_SIZE;
+  int pages_y = (level->height + VIRTUAL_PAGE_SIZE - 1) / VIRTUAL_PAGE_SIZE;
+  for(int py=0;py<pages_y;py++) {
+    for(int px=0;px<pages_x;px++) {
+      for(int y=0;y<VIRTUAL_PAGE_STRIDE;y++) {
+        int sy = py*VIRTUAL_PAGE_SIZE - VIRTUAL_PAGE_BORDER + y;
+        sy = sy < 0 ? 0 : sy >= level->height ? level->height - 1 : sy;
+        for(int x=0;x<VIRTUAL_PAGE_STRIDE;x++) {
+          int sx = px*VIRTUAL_PAGE_SIZE - VIRTUAL_PAGE_BORDER + x;
+          sx = sx < 0 ? 0 : sx >= level->width ? level->width - 1 : sx;
+          memcpy(page + (y*VIRTUAL_PAGE_STRIDE + x)*4, level->pixels + ((size_t)sy*level->width + sx)*4, 4);
+        }
+      }
+      if(fwrite(page, 1, VIRTUAL_PAGE_BYTES, f) != VIRTUAL_PAGE_BYTES)
+        return 0;
+    }
+  }
+  return 1;
+}
+
+static int write_virtual_texture(const char *path, image_level *levels, int count) {
+  virtual_texture_header h;
+  memset(&h, 0, sizeof(h));
+  h.magic = VIRTUAL_TEXTURE_MAGIC;
+  h.version = VIRTUAL_TEXTURE_VERSION;
+  h.width = levels[0].width;
+  h.height = levels[0].height;
+
+  // Stop at the first level that fits in a single page.
+  uint64_t at = TEXTURE_FILE_ALIGNMENT;
+  while((int)h.level_count < count) {
+    int l = h.level_count++;
+    h.level_offset[l] = at;
+    at += (uint64_t)virtual_level_pages(h.width, l) * virtual_level_pages(h.height, l) * VIRTUAL_PAGE_BYTES;
+    if(virtual_level_pages(h.width, l) == 1 && virtual_level_pages(h.height, l) == 1)
+      break;
+  }
+
+  FILE *f = fopen(path, "wb");
+  if(!f) {
+    fprintf(stderr, "Unable to open %s for writing\n", path);
+    return 0;
+  }
+  static const unsigned char zeros[TEXTURE_FILE_ALIGNMENT] = { 0 };
+  unsigned char *page = (unsigned char *)malloc(VIRTUAL_PAGE_BYTES);
+  int ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+           fwrite(zeros, 1, TEXTURE_FILE_ALIGNMENT - sizeof(h), f) == TEXTURE_FILE_ALIGNMENT - sizeof(h);
+  for(uint32_t l=0;ok && l<h.level_count;l++)
+    ok = write_virtual_level(f, &levels[l], page);
+  free(page);
+  if(fclose(f) != 0)
+    ok = 0;
+  if(ok)
+    fprintf(stderr, "%s: %ux%u virtual, %u levels, %.1f MB\n", path, h.width, h.height,
+            h.level_count, at / (1024.0 * 1024.0));
+  else
+    fprintf(stderr, "Failed writing %s\n", path);
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  int format = TEXTURE_FORMAT_RGBA8, mips = 1, virtual_texture = 0;
+  const char *input = NULL, *output = NULL;
+  for(int i=1;i<argc;i++) {
+    if(!strcmp(argv[i], "--bgra")) format = TEXTURE_FORMAT_BGRA8;
+    else if(!strcmp(argv[i], "--bc1")) format = TEXTURE_FORMAT_BC1;
+    else if(!strcmp(argv[i], "--bc3")) format = TEXTURE_FORMAT_BC3;
+    else if(!strcmp(argv[i], "--no-mips")) mips = 0;
+    else if(!strcmp(argv[i], "--virtual")) virtual_texture = 1;
+    else if(!input) input = argv[i];
+    else if(!output) output = argv[i];
+  }
+  if(!input || !output) {
+    fprintf(stderr, "usage: %s [--bgra | --bc1 | --bc3] [--no-mips] input output.tex\n"
+            "       %s --virtual input output.vtex\n", argv[0], argv[0]);
+    return 1;
+  }
+
+  int width, height, channels;
+  unsigned char *pixels = stbi_load(input, &width, &height, &channels, 4);
+  if(!pixels) {
+    fprintf(stderr, "%s: %s\n", input, stbi_failure_reason());
+    return 1;
+  }
+
+  image_level levels[TEXTURE_FILE_MAX_LEVELS];
+  int count = 1;
+  levels[0].width = width;
+  levels[0].height = height;
+  levels[0].pixels = pixels;
+  levels[0].size = (size_t)width * height * 4;
+  while((mips || virtual_texture) && count < TEXTURE_FILE_MAX_LEVELS &&
+        (levels[count-1].width > 1 || levels[count-1].height > 1)) {
+    levels[count] = downsample(&levels[count-1]);
+    count++;
+  }
+
+  if(virtual_texture) {
+    int ok = write_virtual_texture(output, levels, count);
+    stbi_image_free(levels[0].pixels);
+    for(int i=1;i<count;i++)
+      free(levels[i].pixels);
+    return ok ? 0 : 1;
+  }
+
+  texture_file_level table[TEXTURE_FILE_MAX_LEVELS];
+  const unsigned char *data[TEXTURE_FILE_MAX_LEVELS];
+  for(int i=0;i<count;i++) {
+    if(format == TEXTURE_FORMAT_BGRA8)
+      swizzle_bgra(&levels[i]);
+    else if(format == TEXTURE_FORMAT_BC1 || format == TEXTURE_FORMAT_BC3)
+      compress_level(&levels[i], format, i == 0);
+    table[i].width = levels[i].width;
+    table[i].height = levels[i].height;
+    table[i].size = levels[i].size;
+    data[i] = levels[i].pixels;
+  }
+
+  uint64_t bytes = write_texture_file(output, format, table, data, count);
+  if(bytes)
+    fprintf(stderr, "%s: %dx%d %s, %d levels, %.1f KB\n", output, width, height,
+            texture_format_name(format), count, bytes / 1024.0);
+
+  if(format == TEXTURE_FORMAT_BC1 || format == TEXTURE_FORMAT_BC3)
+    free(levels[0].pixels);
+  else
+    stbi_image_free(levels[0].pixels);
+  for(int i=1;i<count;i++)
+    free(levels[i].pixels);
+  return bytes ? 0 : 1;
+}
@@ -0,0 +1,198 @@
+#include "texture_atlas.h"
+#include "gl_state.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int add_page(texture_atlas *a) {
+  a->pages = (atlas_page *)realloc(a->pages, (a->page_count + 1) * sizeof(atlas_page));
+  atlas_page *p = &a->pages[a->page_count];
+  memset(p, 0, sizeof(*p));
+
+  p->node_capacity = 64;
+  p->skyline = (skyline_node *)malloc(p->node_capacity * sizeof(skyline_node));
+  p->skyline[0].x = 0;
+  p->skyline[0].y = 0;
+  p->skyline[0].width = a->page_size;
+  p->node_count = 1;
+
+  glGenTextures(1, &p->texture);
+  state_bind_texture(0, GL_TEXTURE_2D, p->texture);
+  state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, a->page_size, a->page_size, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+  state_tex_parameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  state_tex_parameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  state_tex_parameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  state_tex_parameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  return a->page_count++;
+}
+
+int atlas_init(texture_atlas *a, int page_size, int padding) {
+  GLint max_size;
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+  if(page_size > max_size) {
+    fprintf(stderr, "atlas: page size %d exceeds GL_MAX_TEXTURE_SIZE %d\n", page_size, max_size);
+    page_size = max_size;
+  }
+  memset(a, 0, sizeof(*a));
+  a->page_size = page_size;
+  a->padding = padding;
+  return 1;
+}
+
+// Height the skyline reaches under a 'width'-wide rectangle placed at
+// node i, or -1 if it runs off the page.
+static int fit_at(const texture_atlas *a, const atlas_page *p, int i, int width, int height) {
+  int x = p->skyline[i].x;
+  if(x + width > a->page_size)
+    return -1;
+  int y = 0, left = width;
+  while(left > 0) {
+    if(p->skyline[i].y > y)
+      y = p->skyline[i].y;
+    if(y + height > a->page_size)
+      return -1;
+    left -= p->skyline[i].width;
+    i++;
+  }
+  return y;
+}
+
+// Bottom-left choice: the lowest resulting top edge, ties going to the
+// narrowest node so wide gaps stay open for wide images.
+static int find_position(const texture_atlas *a, const atlas_page *p, int width, int height, int *best_x, int *best_y) {
+  int best = -1, best_top = a->page_size + 1, best_width = 0;
+  for(int i=0;i<p->node_count;i++) {
+    int y = fit_at(a, p, i, width, height);
+    if(y < 0)
+      continue;
+    if(y + height < best_top || (y + height == best_top && p->skyline[i].width < best_width)) {
+      best = i;
+      best_top = y + height;
+      best_width = p->skyline[i].width;
+      *best_x = p->skyline[i].x;
+      *best_y = y;
+    }
+  }
+  return best;
+}
+
+static void place(atlas_page *p, int index, int x, int y, int width, int height) {
+  if(p->node_count == p->node_capacity) {
+    p->node_capacity *= 2;
+    p->skyline = (skyline_node *)realloc(p->skyline, p->node_capacity * sizeof(skyline_node));
+  }
+  memmove(&p->skyline[index + 1], &p->skyline[index], (p->node_count - index) * sizeof(skyline_node));
+  p->skyline[index].x = x;
+  p->skyline[index].y = y + height;
+  p->skyline[index].width = width;
+  p->node_count++;
+
+  // Trim or drop the nodes the new one now covers.
+  for(int i=index+1;i<p->node_count;i++) {
+    skyline_node *prev = &p->skyline[i-1], *n = &p->skyline[i];
+    if(n->x >= prev->x + prev->width)
+      break;
+    int shrink = prev->x + prev->width - n->x;
+    n->x += shrink;
+    n->width -= shrink;
+    if(n->width > 0)
+      break;
+    memmove(n, n + 1, (p->node_count - i - 1) * sizeof(skyline_node));
+    p->node_count--;
+    i--;
+  }
+
+  // Merge neighbours at the same height.
+  for(int i=0;i<p->node_count-1;i++) {
+    if(p->skyline[i].y == p->skyline[i+1].y) {
+      p->skyline[i].width += p->skyline[i+1].width;
+      memmove(&p->skyline[i+1], &p->skyline[i+2], (p->node_count - i - 2) * sizeof(skyline_node));
+      p->node_count--;
+      i--;
+    }
+  }
+  p->used_texels += (long long)width * height;
+}
+
+// Copies the image into scratch with its border texels repeated out into
+// the padding, then uploads image and padding in one glTexSubImage2D.
+static void upload_padded(texture_atlas *a, atlas_page *p, int x, int y, const unsigned char *rgba, int width, int height) {
+  int pad = a->padding, pw = width + 2*pad, ph = height + 2*pad;
+  if(pw * ph * 4 > a->scratch_size) {
+    a->scratch_size = pw * ph * 4;
+    a->scratch = (unsigned char *)realloc(a->scratch, a->scratch_size);
+  }
+  for(int row=0;row<ph;row++) {
+    int sy = row - pad < 0 ? 0 : row - pad >= height ? height - 1 : row - pad;
+    unsigned int *dst = (unsigned int *)(a->scratch + row * pw * 4);
+    const unsigned int *src = (const unsigned int *)(rgba + sy * width * 4);
+    for(int col=0;col<pad;col++) {
+      dst[col] = src[0];
+      dst[pad + width + col] = src[width - 1];
+    }
+    memcpy(dst + pad, src, width * 4);
+  }
+
+  state_bind_texture(0, GL_TEXTURE_2D, p->texture);
+  state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, pw, ph, GL_RGBA, GL_UNSIGNED_BYTE, a->scratch);
+}
+
+// Adds an RGBA image to the first page with room for it. Returns 0 only
+// if the image plus padding cannot fit on an empty page.
+int atlas_add(texture_atlas *a, const unsigned char *rgba, int width, int height, atlas_rect *out) {
+  int pw = width + 2*a->padding, ph = height + 2*a->padding;
+  if(pw > a->page_size || ph > a->page_size) {
+    fprintf(stderr, "atlas: %dx%d image does not fit a %d page\n", width, height, a->page_size);
+    return 0;
+  }
+
+  int page = -1, index = -1, x = 0, y = 0;
+  for(int i=0;i<a->page_count && index < 0;i++) {
+    index = find_position(a, &a->pages[i], pw, ph, &x, &y);
+    page = i;
+  }
+  if(index < 0) {
+    page = add_page(a);
+    index = find_position(a, &a->pages[page], pw, ph, &x, &y);
+  }
+
+  atlas_page *p = &a->pages[page];
+  place(p, index, x, y, pw, ph);
+  upload_padded(a, p, x, y, rgba, width, height);
+  a->images++;
+
+  float scale = 1.0f / a->page_size;
+  out->texture = p->texture;
+  out->page = page;
+  out->x = x + a->padding;
+  out->y = y + a->padding;
+  out->w = width;
+  out->h = height;
+  out->u0 = out->x * scale;
+  out->v0 = out->y * scale;
+  out->u1 = (out->x + width) * scale;
+  out->v1 = (out->y + height) * scale;
+  return 1;
+}
+
+void atlas_report(texture_atlas *a) {
+  long long area = (long long)a->page_size * a->page_size;
+  fprintf(stderr, "atlas: %d images on %d %dx%d pages\n", a->images, a->page_count, a->page_size, a->page_size);
+  for(int i=0;i<a->page_count;i++)
+    fprintf(stderr, "  page %d: %.1f%% used, %d skyline nodes\n", i,
+            100.0 * a->pages[i].used_texels / area, a->pages[i].node_count);
+}
+
+void atlas_destroy(texture_atlas *a) {
+  for(int i=0;i<a->page_count;i++) {
+    state_forget_texture(a->pages[i].texture);
+    glDeleteTextures(1, &a->pages[i].texture);
+    free(a->pages[i].skyline);
+  }
+  free(a->pages);
+  free(a->scratch);
+  memset(a, 0, sizeof(*a));
+}
@@ -0,0 +1,46 @@
+#ifndef TEXTURE_ATLAS_H
+#define TEXTURE_ATLAS_H
+
+#include <glad/glad.h>
+
+// Where an image landed: its page texture, texel rectangle and the UVs to
+// sample it with. The padding around it is not part of the rectangle.
+struct atlas_rect {
+  GLuint texture;
+  int page;
+  int x, y, w, h;
+  float u0, v0, u1, v1;
+};
+
+struct skyline_node {
+  int x, y, width;
+};
+
+struct atlas_page {
+  GLuint texture;
+  skyline_node *skyline;
+  int node_count, node_capacity;
+  long long used_texels;
+};
+
+// Packs small RGBA images into large page textures with a bottom-left
+// skyline packer, opening a new page when the current ones are full. Each
+// image is surrounded by 'padding' texels copied from its own edges so
+// bilinear filtering never blends in a neighbour. Drawing everything on
+// one page through the sprite batch is then a single bind and draw.
+struct texture_atlas {
+  int page_size;
+  int padding;
+  atlas_page *pages;
+  int page_count;
+  int images;
+  unsigned char *scratch;
+  int scratch_size;
+};
+
+int atlas_init(texture_atlas *a, int page_size, int padding);
+int atlas_add(texture_atlas *a, const unsigned char *rgba, int width, int height, atlas_rect *out);
+void atlas_report(texture_atlas *a);
+void atlas_destroy(texture_atlas *a);
+
+#endif
@@ -0,0 +1,137 @@
+#include "texture_cache.h"
+#include "gl_state.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void texture_loaded(void *user, GLuint texture, size_t gpu_bytes, size_t cpu_bytes) {
+  texture_cache *c = (texture_cache *)user;
+  for(int i=0;i<c->count;i++) {
+    texture_cache_entry *e = &c->entries[i];
+    if(e->texture != texture || !e->pending)
+      continue;
+    e->pending = 0;
+    e->gpu_bytes = gpu_bytes;
+    e->cpu_bytes = cpu_bytes;
+    c->stats.resident_bytes += gpu_bytes;
+    c->stats.decoded_bytes += cpu_bytes;
+    return;
+  }
+}
+
+void texture_cache_init(texture_cache *c, texture_loader *loader, size_t budget) {
+  memset(c, 0, sizeof(*c));
+  c->loader = loader;
+  c->budget = budget;
+  loader->on_loaded = texture_loaded;
+  loader->on_loaded_user = c;
+}
+
+static int ends_with(const char *s, const char *suffix) {
+  size_t n = strlen(s), m = strlen(suffix);
+  return n >= m && !strcmp(s + n - m, suffix);
+}
+
+static void load_entry(texture_cache *c, texture_cache_entry *e) {
+  c->stats.resident++;
+  if(ends_with(e->path, ".tex")) {
+    glGenTextures(1, &e->texture);
+    if(load_texture_file(e->path, e->texture, &e->gpu_bytes)) {
+      e->cpu_bytes = 0;
+      c->stats.resident_bytes += e->gpu_bytes;
+      return;
+    }
+    state_forget_texture(e->texture);
+    glDeleteTextures(1, &e->texture);
+  }
+  e->pending = 1;
+  e->gpu_bytes = 0;
+  e->texture = texture_load_async(c->loader, e->path, e->options);
+}
+
+static void evict_entry(texture_cache *c, texture_cache_entry *e) {
+  state_forget_texture(e->texture);
+  glDeleteTextures(1, &e->texture);
+  e->texture = 0;
+  c->stats.resident--;
+  c->stats.resident_bytes -= e->gpu_bytes;
+  c->stats.evictions++;
+}
+
+GLuint texture_cache_get(texture_cache *c, const char *path, int options) {
+  texture_cache_entry *e = NULL;
+  for(int i=0;i<c->count;i++) {
+    if(c->entries[i].options == options && !strcmp(c->entries[i].path, path)) {
+      e = &c->entries[i];
+      break;
+    }
+  }
+
+  if(!e) {
+    if(c->count == c->capacity) {
+      c->capacity = c->capacity ? c->capacity * 2 : 16;
+      c->entries = (texture_cache_entry *)realloc(c->entries, c->capacity * sizeof(texture_cache_entry));
+    }
+    e = &c->entries[c->count++];
+    memset(e, 0, sizeof(*e));
+    e->path = strdup(path);
+    e->options = options;
+  }
+
+  e->last_used = c->frame;
+  if(e->texture) {
+    c->stats.hits++;
+    return e->texture;
+  }
+  c->stats.misses++;
+  load_entry(c, e);
+  return e->texture;
+}
+
+// Call once per frame after drawing. Evicts least recently used textures
+// until resident bytes fit the budget; textures still loading, or drawn
+// within the last TEXTURE_CACHE_KEEP_FRAMES frames, are never evicted.
+void texture_cache_end_frame(texture_cache *c) {
+  while(c->stats.resident_bytes > c->budget) {
+    texture_cache_entry *oldest = NULL;
+    for(int i=0;i<c->count;i++) {
+      texture_cache_entry *e = &c->entries[i];
+      if(!e->texture || e->pending || c->frame - e->last_used < TEXTURE_CACHE_KEEP_FRAMES)
+        continue;
+      if(!oldest || e->last_used < oldest->last_used)
+        oldest = e;
+    }
+    if(!oldest)
+      break;
+    evict_entry(c, oldest);
+  }
+  c->frame++;
+}
+
+void texture_cache_report(texture_cache *c) {
+  texture_cache_stats *s = &c->stats;
+  fprintf(stderr, "texture cache: %d hits, %d misses, %d evictions, %d resident, %.1f/%.1f MB, %.1f MB decoded\n",
+          s->hits, s->misses, s->evictions, s->resident,
+          s->resident_bytes / (1024.0 * 1024.0), c->budget / (1024.0 * 1024.0),
+          s->decoded_bytes / (1024.0 * 1024.0));
+  for(int i=0;i<c->count;i++) {
+    texture_cache_entry *e = &c->entries[i];
+    fprintf(stderr, "  %s [%d]: %s, %.1f KB GPU, %.1f KB CPU, last used frame %d\n", e->path, e->options,
+            e->pending ? "loading" : e->texture ? "resident" : "evicted",
+            e->gpu_bytes / 1024.0, e->cpu_bytes / 1024.0, e->last_used);
+  }
+}
+
+void texture_cache_destroy(texture_cache *c) {
+  for(int i=0;i<c->count;i++) {
+    if(c->entries[i].texture) {
+      state_forget_texture(c->entries[i].texture);
+      glDeleteTextures(1, &c->entries[i].texture);
+    }
+    free(c->entries[i].path);
+  }
+  free(c->entries);
+  if(c->loader->on_loaded_user == c)
+    c->loader->on_loaded = NULL;
+  memset(c, 0, sizeof(*c));
+}
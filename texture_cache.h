@@ -0,0 +1,51 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include "texture_loader.h"
+#include <stddef.h>
+
+// Frames a texture must go unused before it may be evicted. Commands
+// still in flight may reference anything drawn more recently.
+#define TEXTURE_CACHE_KEEP_FRAMES 3
+
+struct texture_cache_entry {
+  char *path;
+  int options;
+  GLuint texture;
+  int pending;
+  size_t gpu_bytes;
+  size_t cpu_bytes;
+  int last_used;
+};
+
+struct texture_cache_stats {
+  int hits, misses, evictions;
+  int resident;
+  size_t resident_bytes;
+  size_t decoded_bytes;
+};
+
+// Textures by (path, load options) under a GPU memory budget. Lookups
+// return a texture straight away; a miss starts an asynchronous load and
+// the caller draws with the placeholder until it lands. When resident
+// bytes pass the budget, the least recently used textures are deleted
+// and come back through the loader the next time they are asked for.
+// Paths ending in .tex are texconv bakes and load synchronously.
+struct texture_cache {
+  texture_loader *loader;
+  size_t budget;
+  int frame;
+
+  texture_cache_entry *entries;
+  int count, capacity;
+
+  texture_cache_stats stats;
+};
+
+void texture_cache_init(texture_cache *c, texture_loader *loader, size_t budget);
+GLuint texture_cache_get(texture_cache *c, const char *path, int options);
+void texture_cache_end_frame(texture_cache *c);
+void texture_cache_report(texture_cache *c);
+void texture_cache_destroy(texture_cache *c);
+
+#endif
@@ -0,0 +1,139 @@
+#include "texture_file.h"
+#include "bc_encode.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+const char *texture_format_name(int format) {
+  switch(format) {
+  case TEXTURE_FORMAT_RGBA8: return "RGBA8";
+  case TEXTURE_FORMAT_BGRA8: return "BGRA8";
+  case TEXTURE_FORMAT_BC1: return "BC1";
+  case TEXTURE_FORMAT_BC3: return "BC3";
+  }
+  return "unknown";
+}
+
+// Pages along one axis of 'level' for an image 'size' texels across.
+int virtual_level_pages(uint32_t size, int level) {
+  uint32_t texels = size >> level ? size >> level : 1;
+  return (texels + VIRTUAL_PAGE_SIZE - 1) / VIRTUAL_PAGE_SIZE;
+}
+
+// Writes a texconv container. Only width, height and size of each entry
+// of 'levels' are read; offsets are assigned here. Returns the file size,
+// or 0 after printing why it failed.
+uint64_t write_texture_file(const char *path, int format, const texture_file_level *levels,
+                            const unsigned char *const *pixels, int count) {
+  texture_file_header h;
+  memset(&h, 0, sizeof(h));
+  h.magic = TEXTURE_FILE_MAGIC;
+  h.version = TEXTURE_FILE_VERSION;
+  h.format = format;
+  h.width = levels[0].width;
+  h.height = levels[0].height;
+  h.level_count = count;
+  uint64_t at = sizeof(h);
+  for(int i=0;i<count;i++) {
+    at = (at + TEXTURE_FILE_ALIGNMENT - 1) / TEXTURE_FILE_ALIGNMENT * TEXTURE_FILE_ALIGNMENT;
+    h.levels[i] = levels[i];
+    h.levels[i].offset = at;
+    at += levels[i].size;
+  }
+
+  FILE *f = fopen(path, "wb");
+  if(!f) {
+    fprintf(stderr, "Unable to open %s for writing\n", path);
+    return 0;
+  }
+  static const unsigned char zeros[TEXTURE_FILE_ALIGNMENT] = { 0 };
+  int ok = fwrite(&h, sizeof(h), 1, f) == 1;
+  uint64_t written = sizeof(h);
+  for(int i=0;ok && i<count;i++) {
+    ok = fwrite(zeros, 1, h.levels[i].offset - written, f) == h.levels[i].offset - written &&
+         fwrite(pixels[i], 1, levels[i].size, f) == levels[i].size;
+    written = h.levels[i].offset + levels[i].size;
+  }
+  if(fclose(f) != 0)
+    ok = 0;
+  if(!ok)
+    fprintf(stderr, "Failed writing %s\n", path);
+  return ok ? at : 0;
+}
+
+// Bytes GL reads for one level, whatever the file claims its size is.
+static uint64_t level_bytes(uint32_t format, uint32_t width, uint32_t height) {
+  switch(format) {
+  case TEXTURE_FORMAT_BC1: return bc_image_size(width, height, BC1_BLOCK_BYTES);
+  case TEXTURE_FORMAT_BC3: return bc_image_size(width, height, BC3_BLOCK_BYTES);
+  }
+  return (uint64_t)width * height * 4;
+}
+
+// Levels must form a mip chain from the header's size down, each stored
+// in full inside the file; dimensions are capped so sizes cannot overflow.
+static int valid_header(const texture_file_header *h, size_t size) {
+  if(h->magic != TEXTURE_FILE_MAGIC || h->version != TEXTURE_FILE_VERSION)
+    return 0;
+  if(h->format > TEXTURE_FORMAT_BC3 || h->level_count == 0 || h->level_count > TEXTURE_FILE_MAX_LEVELS)
+    return 0;
+  if(!h->width || !h->height || h->width >> TEXTURE_FILE_MAX_LEVELS || h->height >> TEXTURE_FILE_MAX_LEVELS)
+    return 0;
+  uint32_t width = h->width, height = h->height;
+  for(uint32_t i=0;i<h->level_count;i++) {
+    const texture_file_level *lv = &h->levels[i];
+    if(lv->width != width || lv->height != height)
+      return 0;
+    if(lv->offset % TEXTURE_FILE_ALIGNMENT || lv->offset > size || lv->size > size - lv->offset)
+      return 0;
+    if(lv->size < level_bytes(h->format, width, height))
+      return 0;
+    width = width > 1 ? width / 2 : 1;
+    height = height > 1 ? height / 2 : 1;
+  }
+  return 1;
+}
+
+// Maps a texconv file read-only and checks its header and level table.
+// Returns NULL (quietly, if the file does not exist) on failure; otherwise
+// release it with vfs_close(file).
+const texture_file_header *map_texture_file(const char *path, vfs_file *file) {
+  if(!vfs_open(path, file))
+    return NULL;
+  const texture_file_header *h = (const texture_file_header *)file->data;
+  if(file->size < sizeof(texture_file_header) || !valid_header(h, file->size)) {
+    fprintf(stderr, "%s: not a texture file\n", path);
+    vfs_close(file);
+    return NULL;
+  }
+  vfs_advise(file, MADV_WILLNEED);
+  return h;
+}
+
+static int valid_virtual_header(const virtual_texture_header *h, size_t size) {
+  if(h->magic != VIRTUAL_TEXTURE_MAGIC || h->version != VIRTUAL_TEXTURE_VERSION)
+    return 0;
+  if(h->level_count == 0 || h->level_count > TEXTURE_FILE_MAX_LEVELS || !h->width || !h->height)
+    return 0;
+  for(uint32_t i=0;i<h->level_count;i++) {
+    uint64_t bytes = (uint64_t)virtual_level_pages(h->width, i) * virtual_level_pages(h->height, i) * VIRTUAL_PAGE_BYTES;
+    if(h->level_offset[i] > size || bytes > size - h->level_offset[i])
+      return 0;
+  }
+  return virtual_level_pages(h->width, h->level_count - 1) == 1 &&
+         virtual_level_pages(h->height, h->level_count - 1) == 1;
+}
+
+const virtual_texture_header *map_virtual_texture_file(const char *path, vfs_file *file) {
+  if(!vfs_open(path, file))
+    return NULL;
+  const virtual_texture_header *h = (const virtual_texture_header *)file->data;
+  if(file->size < sizeof(virtual_texture_header) || !valid_virtual_header(h, file->size)) {
+    fprintf(stderr, "%s: not a virtual texture file\n", path);
+    vfs_close(file);
+    return NULL;
+  }
+  // Pages are read in whatever order the feedback asks for them.
+  vfs_advise(file, MADV_RANDOM);
+  return h;
+}
@@ -0,0 +1,66 @@
+#ifndef TEXTURE_FILE_H
+#define TEXTURE_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "vfs.h"
+
+// Baked texture container written by texconv and mapped through the vfs. Every
+// mip level starts on a TEXTURE_FILE_ALIGNMENT boundary so it can be
+// handed to GL straight out of the mapping.
+#define TEXTURE_FILE_MAGIC 0x58455454u /* "TTEX" */
+#define TEXTURE_FILE_VERSION 1
+#define TEXTURE_FILE_ALIGNMENT 4096
+#define TEXTURE_FILE_MAX_LEVELS 16
+
+enum texture_file_format {
+  TEXTURE_FORMAT_RGBA8,
+  TEXTURE_FORMAT_BGRA8,
+  TEXTURE_FORMAT_BC1,
+  TEXTURE_FORMAT_BC3
+};
+
+struct texture_file_level {
+  uint32_t width, height;
+  uint64_t offset, size;
+};
+
+struct texture_file_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t format;
+  uint32_t width, height;
+  uint32_t level_count;
+  uint32_t reserved[2];
+  texture_file_level levels[TEXTURE_FILE_MAX_LEVELS];
+};
+
+// Tiled mip pyramid for virtual texturing. Level l is max(1, width >> l)
+// by max(1, height >> l) texels cut into VIRTUAL_PAGE_SIZE pages, stored
+// row-major from level_offset[l]. Each stored page carries a border of
+// VIRTUAL_PAGE_BORDER texels from its neighbours so it filters cleanly on
+// its own; the last level is a single page.
+#define VIRTUAL_TEXTURE_MAGIC 0x58455456u /* "VTEX" */
+#define VIRTUAL_TEXTURE_VERSION 1
+#define VIRTUAL_PAGE_SIZE 128
+#define VIRTUAL_PAGE_BORDER 4
+#define VIRTUAL_PAGE_STRIDE (VIRTUAL_PAGE_SIZE + 2*VIRTUAL_PAGE_BORDER)
+#define VIRTUAL_PAGE_BYTES (VIRTUAL_PAGE_STRIDE * VIRTUAL_PAGE_STRIDE * 4)
+
+struct virtual_texture_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t width, height;
+  uint32_t level_count;
+  uint32_t reserved[3];
+  uint64_t level_offset[TEXTURE_FILE_MAX_LEVELS];
+};
+
+const char *texture_format_name(int format);
+int virtual_level_pages(uint32_t size, int level);
+uint64_t write_texture_file(const char *path, int format, const texture_file_level *levels,
+                            const unsigned char *const *pixels, int count);
+const texture_file_header *map_texture_file(const char *path, vfs_file *file);
+const virtual_texture_header *map_virtual_texture_file(const char *path, vfs_file *file);
+
+#endif
@@ -0,0 +1,315 @@
+#include "texture_loader.h"
+#include "gl_state.h"
+#include "texture_file.h"
+#include "stb_image.h"
+#include "image_arena.h"
+#include <GLFW/glfw3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+
+static void decode_jobs(texture_loader *l) {
+  for(;;) {
+    texture_job *job;
+    {
+      std::unique_lock<std::mutex> hold(l->lock);
+      l->wake.wait(hold, [l] { return l->queued || !l->running; });
+      if(!l->running) {
+        image_arena_release();
+        return;
+      }
+      job = l->queued;
+      l->queued = job->next;
+      if(!l->queued)
+        l->queued_tail = NULL;
+    }
+
+    double start = glfwGetTime();
+    // Decode straight out of the mapping, and take the pixels in their
+    // stored channel count: asking stb for four channels would make it
+    // allocate and fill a second image just to add the alpha.
+    vfs_file file;
+    if(vfs_open(job->path, &file)) {
+      vfs_advise(&file, MADV_SEQUENTIAL);
+      job->pixels = decode_image((const unsigned char *)file.data, (int)file.size,
+                                 &job->width, &job->height, &job->channels, 0);
+      if(!job->pixels)
+        fprintf(stderr, "texture loader: %s: %s\n", job->path, stbi_failure_reason());
+      vfs_close(&file);
+    } else {
+      fprintf(stderr, "texture loader: could not open %s\n", job->path);
+    }
+    job->decode_seconds = glfwGetTime() - start;
+
+    {
+      std::lock_guard<std::mutex> hold(l->lock);
+      job->next = l->decoded;
+      l->decoded = job;
+    }
+    glfwPostEmptyEvent();
+  }
+}
+
+int texture_loader_init(texture_loader *l, int threads) {
+  if(threads <= 0) {
+    threads = std::thread::hardware_concurrency() - 1;
+    if(threads < 1) threads = 1;
+  }
+  if(threads > TEXTURE_LOADER_MAX_THREADS)
+    threads = TEXTURE_LOADER_MAX_THREADS;
+
+  l->queued = l->queued_tail = NULL;
+  l->decoded = NULL;
+  l->requested = l->uploaded = l->failed = 0;
+  l->decode_seconds = 0;
+  l->upload_backlog = 0;
+  l->bgra = 0;
+  l->on_loaded = NULL;
+  l->on_loaded_user = NULL;
+  glGenBuffers(1, &l->upload_buffer);
+
+  l->running = 1;
+  l->worker_count = threads;
+  for(int i=0;i<threads;i++)
+    l->workers[i] = std::thread(decode_jobs, l);
+  return 1;
+}
+
+static void upload_placeholder(GLuint texture) {
+  static const unsigned char checker[16] = {
+    255, 0, 255, 255,   0, 0, 0, 255,
+    0, 0, 0, 255,       255, 0, 255, 255
+  };
+  state_bind_texture(0, GL_TEXTURE_2D, texture);
+  state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 2, 2, 0, GL_RGBA, GL_UNSIGNED_BYTE, checker);
+  state_tex_parameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  state_tex_parameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  state_tex_parameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  state_tex_parameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+}
+
+// Returns a texture that is usable immediately. Its contents are replaced
+// by the decoded image during a later texture_loader_poll.
+GLuint texture_load_async(texture_loader *l, const char *path, int options) {
+  texture_job *job = (texture_job *)calloc(1, sizeof(texture_job));
+  job->path = strdup(path);
+  job->options = options;
+  glGenTextures(1, &job->texture);
+  upload_placeholder(job->texture);
+
+  {
+    std::lock_guard<std::mutex> hold(l->lock);
+    if(l->queued_tail)
+      l->queued_tail->next = job;
+    else
+      l->queued = job;
+    l->queued_tail = job;
+  }
+  l->wake.notify_one();
+  l->requested++;
+  return job->texture;
+}
+
+// Writes 'count' pixels of 1-4 channels to dst as four-channel texels.
+// dst is write-combined mapped memory, so every store is a whole texel
+// and nothing is read back from it.
+static void expand_pixels(unsigned int *dst, const unsigned char *src, int count, int channels, int bgra) {
+  int r = bgra ? 16 : 0, b = bgra ? 0 : 16;
+  switch(channels) {
+  case 1:
+    for(int i=0;i<count;i++)
+      dst[i] = src[i] * 0x010101u | 0xFF000000u;
+    break;
+  case 2:
+    for(int i=0;i<count;i++, src += 2)
+      dst[i] = src[0] * 0x010101u | (unsigned int)src[1] << 24;
+    break;
+  case 3:
+    for(int i=0;i<count;i++, src += 3)
+      dst[i] = (unsigned int)src[0] << r | (unsigned int)src[1] << 8 | (unsigned int)src[2] << b | 0xFF000000u;
+    break;
+  default:
+    if(!bgra) {
+      memcpy(dst, src, (size_t)count * 4);
+      break;
+    }
+    for(int i=0;i<count;i++, src += 4)
+      dst[i] = (unsigned int)src[0] << 16 | (unsigned int)src[1] << 8 | src[2] | (unsigned int)src[3] << 24;
+    break;
+  }
+}
+
+static int upload_job(texture_loader *l, texture_job *job) {
+  GLsizeiptr size = (GLsizeiptr)job->width * job->height * 4;
+
+  // Orphan and refill the unpack buffer so the write never waits on the
+  // previous upload; glTexImage2D then sources from GPU-visible memory.
+  state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, l->upload_buffer);
+  glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+  void *dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+  if(!dst) {
+    fprintf(stderr, "texture loader: %s: could not map upload buffer\n", job->path);
+    state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    l->failed++;
+    return 0;
+  }
+  expand_pixels((unsigned int *)dst, job->pixels, job->width * job->height, job->channels, l->bgra);
+  glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+  state_bind_texture(0, GL_TEXTURE_2D, job->texture);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, job->width, job->height, 0,
+               l->bgra ? GL_BGRA : GL_RGBA, GL_UNSIGNED_BYTE, (void *)0);
+  state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  GLint filter = job->options & TEXTURE_NEAREST ? GL_NEAREST : GL_LINEAR;
+  if(job->options & TEXTURE_NO_MIPMAPS) {
+    state_tex_parameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+  } else {
+    glGenerateMipmap(GL_TEXTURE_2D);
+    state_tex_parameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                         job->options & TEXTURE_NEAREST ? GL_NEAREST_MIPMAP_NEAREST : GL_LINEAR_MIPMAP_LINEAR);
+  }
+  state_tex_parameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+
+  l->uploaded++;
+  l->decode_seconds += job->decode_seconds;
+  fprintf(stderr, "texture loader: %s: %dx%d, %d channels, decoded in %.1f ms\n",
+          job->path, job->width, job->height, job->channels, job->decode_seconds * 1000);
+
+  if(l->on_loaded) {
+    size_t cpu_bytes = (size_t)job->width * job->height * job->channels;
+    size_t gpu_bytes = job->options & TEXTURE_NO_MIPMAPS ? size : size + size / 3;
+    l->on_loaded(l->on_loaded_user, job->texture, gpu_bytes, cpu_bytes);
+  }
+  return 1;
+}
+
+static void free_job(texture_job *job) {
+  stbi_image_free(job->pixels);
+  free(job->path);
+  free(job);
+}
+
+// Call once per frame on the GL thread. Uploads at most max_uploads
+// finished images (all of them if max_uploads <= 0) so a burst of loads
+// is spread over several frames. Returns how many textures changed and
+// sets l->upload_backlog to the number of images held back.
+int texture_loader_poll(texture_loader *l, int max_uploads) {
+  texture_job *done;
+  {
+    std::lock_guard<std::mutex> hold(l->lock);
+    done = l->decoded;
+    l->decoded = NULL;
+  }
+
+  int changed = 0;
+  l->upload_backlog = 0;
+  while(done) {
+    texture_job *job = done;
+    done = job->next;
+
+    if(max_uploads > 0 && changed >= max_uploads) {
+      std::lock_guard<std::mutex> hold(l->lock);
+      job->next = l->decoded;
+      l->decoded = job;
+      l->upload_backlog++;
+      continue;
+    }
+
+    if(job->pixels && upload_job(l, job)) {
+      changed++;
+    } else {
+      if(!job->pixels)
+        l->failed++;
+      if(l->on_loaded)
+        l->on_loaded(l->on_loaded_user, job->texture, 0, 0);
+    }
+    free_job(job);
+  }
+  return changed;
+}
+
+// Uploads every level of a texconv file into 'texture' directly from the
+// mapping; there is no decode, so the cost is the page-ins. Returns 0 if
+// the file is missing, malformed, or needs S3TC the driver lacks, leaving
+// the caller free to fall back to the source image.
+int load_texture_file(const char *path, GLuint texture, size_t *gpu_bytes) {
+  double start = glfwGetTime();
+  vfs_file file;
+  const texture_file_header *h = map_texture_file(path, &file);
+  if(!h)
+    return 0;
+
+  int compressed = h->format == TEXTURE_FORMAT_BC1 || h->format == TEXTURE_FORMAT_BC3;
+  if(compressed && !glfwExtensionSupported("GL_EXT_texture_compression_s3tc")) {
+    fprintf(stderr, "%s: %s needs GL_EXT_texture_compression_s3tc\n", path, texture_format_name(h->format));
+    vfs_close(&file);
+    return 0;
+  }
+
+  const unsigned char *data = (const unsigned char *)h;
+  size_t bytes = 0;
+  state_bind_texture(0, GL_TEXTURE_2D, texture);
+  state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  for(uint32_t i=0;i<h->level_count;i++) {
+    const texture_file_level *lv = &h->levels[i];
+    const void *pixels = data + lv->offset;
+    bytes += lv->size;
+    switch(h->format) {
+    case TEXTURE_FORMAT_RGBA8:
+      glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA8, lv->width, lv->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+      break;
+    case TEXTURE_FORMAT_BGRA8:
+      glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA8, lv->width, lv->height, 0, GL_BGRA, GL_UNSIGNED_BYTE, pixels);
+      break;
+    case TEXTURE_FORMAT_BC1:
+      glCompressedTexImage2D(GL_TEXTURE_2D, i, GL_COMPRESSED_RGBA_S3TC_DXT1_EXT, lv->width, lv->height, 0, lv->size, pixels);
+      break;
+    case TEXTURE_FORMAT_BC3:
+      glCompressedTexImage2D(GL_TEXTURE_2D, i, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, lv->width, lv->height, 0, lv->size, pixels);
+      break;
+    }
+  }
+  state_tex_parameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, h->level_count - 1);
+  state_tex_parameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, h->level_count > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+  state_tex_parameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+  fprintf(stderr, "%s: %ux%u %s, %u levels, %.1f MB in %.1f ms\n", path, h->width, h->height,
+          texture_format_name(h->format), h->level_count, file.size / (1024.0 * 1024.0),
+          (glfwGetTime() - start) * 1000);
+  vfs_close(&file);
+  if(gpu_bytes)
+    *gpu_bytes = bytes;
+  return 1;
+}
+
+void texture_loader_destroy(texture_loader *l) {
+  {
+    std::lock_guard<std::mutex> hold(l->lock);
+    l->running = 0;
+  }
+  l->wake.notify_all();
+  for(int i=0;i<l->worker_count;i++)
+    l->workers[i].join();
+
+  texture_job *lists[2] = { l->queued, l->decoded };
+  for(int i=0;i<2;i++) {
+    while(lists[i]) {
+      texture_job *next = lists[i]->next;
+      free_job(lists[i]);
+      lists[i] = next;
+    }
+  }
+  l->queued = l->queued_tail = l->decoded = NULL;
+
+  state_forget_buffer(l->upload_buffer);
+  glDeleteBuffers(1, &l->upload_buffer);
+  l->upload_buffer = 0;
+}
@@ -0,0 +1,69 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <glad/glad.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#define TEXTURE_LOADER_MAX_THREADS 8
+
+// Load options; part of a texture's identity in the texture cache.
+#define TEXTURE_NO_MIPMAPS 1
+#define TEXTURE_NEAREST 2
+
+// Called on the GL thread after each upload, or with zero sizes when the
+// load failed. gpu_bytes includes the mip chain; cpu_bytes is the decoded
+// image held between decode and upload.
+typedef void (*texture_loaded_proc)(void *user, GLuint texture, size_t gpu_bytes, size_t cpu_bytes);
+
+struct texture_job {
+  char *path;
+  int options;
+  GLuint texture;
+  unsigned char *pixels;
+  int width, height, channels;
+  double decode_seconds;
+  texture_job *next;
+};
+
+// Loads image files without blocking the GL thread. texture_load_async
+// hands back a texture name at once, holding a small checkerboard; worker
+// threads decode straight from the file's vfs mapping with decode_image,
+// whose scratch comes from a per-thread arena, and keep the decoded
+// pixels in their native channel count. texture_loader_poll, on the
+// GL thread, expands them to four channels while writing them into a mapped
+// pixel-unpack buffer, in RGBA or (with bgra set) BGRA order.
+struct texture_loader {
+  std::thread workers[TEXTURE_LOADER_MAX_THREADS];
+  int worker_count;
+  int running;
+
+  std::mutex lock;
+  std::condition_variable wake;
+  texture_job *queued, *queued_tail;
+  texture_job *decoded;
+
+  GLuint upload_buffer;
+  int bgra;
+
+  texture_loaded_proc on_loaded;
+  void *on_loaded_user;
+
+  int requested, uploaded, failed;
+  double decode_seconds;
+
+  // Decoded images the last poll left for later ones because of its
+  // upload limit. Their wake-up events are already spent, so the caller
+  // must keep polling while this is nonzero.
+  int upload_backlog;
+};
+
+int texture_loader_init(texture_loader *l, int threads);
+GLuint texture_load_async(texture_loader *l, const char *path, int options);
+int texture_loader_poll(texture_loader *l, int max_uploads);
+void texture_loader_destroy(texture_loader *l);
+
+int load_texture_file(const char *path, GLuint texture, size_t *gpu_bytes);
+
+#endif
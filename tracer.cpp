@@ -0,0 +1,413 @@
+#include "tracer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <time.h>
+#include <algorithm>
+#include <emmintrin.h>
+
+#define BVH_STACK_DEPTH 64
+
+#define TRI_T_MIN 1e-4f
+#define BOX_FAR_SCALE (1.0f + 3*FLT_EPSILON)
+
+struct build_tri {
+  float v0[3], v1[3], v2[3];
+  float centroid[3];
+  int id;
+};
+
+struct bvh_builder {
+  build_tri *tris;
+  bvh_node *nodes;
+  int node_count, node_capacity;
+  tri_pack *packs;
+  int pack_count, pack_capacity;
+};
+
+static void transform_point(const mat4 &m, const float in[3], float out[3]) {
+  for(int k=0;k<3;k++)
+    out[k] = m.m[k]*in[0] + m.m[4+k]*in[1] + m.m[8+k]*in[2] + m.m[12+k];
+}
+
+static int new_node(bvh_builder *b) {
+  if(b->node_count == b->node_capacity) {
+    b->node_capacity = b->node_capacity ? b->node_capacity * 2 : 256;
+    b->nodes = (bvh_node *)realloc(b->nodes, b->node_capacity * sizeof(bvh_node));
+  }
+  return b->node_count++;
+}
+
+static int emit_packs(bvh_builder *b, int first, int count) {
+  int packs = (count + TRI_PACK_WIDTH - 1) / TRI_PACK_WIDTH;
+  if(b->pack_count + packs > b->pack_capacity) {
+    while(b->pack_count + packs > b->pack_capacity)
+      b->pack_capacity = b->pack_capacity ? b->pack_capacity * 2 : 256;
+    b->packs = (tri_pack *)realloc(b->packs, b->pack_capacity * sizeof(tri_pack));
+  }
+  int start = b->pack_count;
+  for(int p=0;p<packs;p++) {
+    tri_pack *pk = &b->packs[b->pack_count++];
+    memset(pk, 0, sizeof(*pk));
+    for(int l=0;l<TRI_PACK_WIDTH;l++) {
+      int i = p*TRI_PACK_WIDTH + l;
+      pk->id[l] = -1;
+      if(i >= count)
+        continue;
+      const build_tri *t = &b->tris[first + i];
+      for(int k=0;k<3;k++) {
+        pk->v0[k][l] = t->v0[k];
+        pk->v1[k][l] = t->v1[k];
+        pk->v2[k][l] = t->v2[k];
+      }
+      pk->id[l] = t->id;
+    }
+  }
+  return start;
+}
+
+// Median split on the longest centroid axis. Cheap to build and good
+// enough for scanned and tessellated meshes, which are fairly uniform.
+static int build_node(bvh_builder *b, int first, int count) {
+  int index = new_node(b);
+  float lo[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, hi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+  float clo[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, chi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+  for(int i=first;i<first+count;i++) {
+    const build_tri *t = &b->tris[i];
+    for(int k=0;k<3;k++) {
+      lo[k] = fminf(lo[k], fminf(t->v0[k], fminf(t->v1[k], t->v2[k])));
+      hi[k] = fmaxf(hi[k], fmaxf(t->v0[k], fmaxf(t->v1[k], t->v2[k])));
+      clo[k] = fminf(clo[k], t->centroid[k]);
+      chi[k] = fmaxf(chi[k], t->centroid[k]);
+    }
+  }
+  memcpy(b->nodes[index].lo, lo, sizeof(lo));
+  memcpy(b->nodes[index].hi, hi, sizeof(hi));
+
+  int axis = 0;
+  for(int k=1;k<3;k++)
+    if(chi[k] - clo[k] > chi[axis] - clo[axis])
+      axis = k;
+
+  if(count <= BVH_LEAF_TRIANGLES || chi[axis] - clo[axis] <= 0) {
+    b->nodes[index].first = emit_packs(b, first, count);
+    b->nodes[index].count = (count + TRI_PACK_WIDTH - 1) / TRI_PACK_WIDTH;
+    return index;
+  }
+
+  int half = count / 2;
+  std::nth_element(b->tris + first, b->tris + first + half, b->tris + first + count,
+                   [axis](const build_tri &x, const build_tri &y) { return x.centroid[axis] < y.centroid[axis]; });
+
+  build_node(b, first, half);
+  int right = build_node(b, first + half, count - half);
+  b->nodes[index].first = right;
+  b->nodes[index].count = 0;
+  return index;
+}
+
+int build_tri_accel(tri_accel *a, const triangle_list *tris, const mat4 &transform) {
+  memset(a, 0, sizeof(*a));
+  if(tris->count <= 0)
+    return 0;
+
+  bvh_builder b;
+  memset(&b, 0, sizeof(b));
+  b.tris = (build_tri *)malloc(tris->count * sizeof(build_tri));
+  for(int i=0;i<tris->count;i++) {
+    build_tri *t = &b.tris[i];
+    float p[3][3];
+    for(int k=0;k<3;k++) {
+      float in[3] = { tris->x[k][i], tris->y[k][i], tris->z[k][i] };
+      transform_point(transform, in, p[k]);
+    }
+    memcpy(t->v0, p[0], sizeof(t->v0));
+    memcpy(t->v1, p[1], sizeof(t->v1));
+    memcpy(t->v2, p[2], sizeof(t->v2));
+    for(int k=0;k<3;k++)
+      t->centroid[k] = (p[0][k] + p[1][k] + p[2][k]) / 3;
+    t->id = i;
+  }
+
+  build_node(&b, 0, tris->count);
+  free(b.tris);
+
+  a->nodes = b.nodes;
+  a->node_count = b.node_count;
+  a->packs = b.packs;
+  a->pack_count = b.pack_count;
+  a->triangle_count = tris->count;
+  return 1;
+}
+
+void free_tri_accel(tri_accel *a) {
+  free(a->nodes);
+  free(a->packs);
+  memset(a, 0, sizeof(*a));
+}
+
+// Slab test. The far distance is pushed out by the worst-case rounding of
+// its float operations (Ize, "Robust BVH Ray Traversal"), otherwise a ray
+// grazing a box face can skip a triangle the watertight test would hit.
+static int hit_box(const bvh_node *n, const float org[3], const float inv[3], float tmax) {
+  float t0 = 0, t1 = tmax;
+  for(int k=0;k<3;k++) {
+    float near = (n->lo[k] - org[k]) * inv[k];
+    float far = (n->hi[k] - org[k]) * inv[k];
+    if(near > far) { float s = near; near = far; far = s; }
+    far *= BOX_FAR_SCALE;
+    t0 = near > t0 ? near : t0;
+    t1 = far < t1 ? far : t1;
+    if(t0 > t1)
+      return 0;
+  }
+  return 1;
+}
+
+// A ray prepared for the watertight test of Woop, Benthin and Wald: the
+// axes are permuted so z is the dominant direction, and the shear maps the
+// ray onto +z. Triangles are then tested in 2D against the origin.
+struct shear_ray {
+  float org[3];
+  int kx, ky, kz;
+  float sx, sy, sz;
+};
+
+static void setup_shear_ray(shear_ray *r, const float org[3], const float dir[3]) {
+  memcpy(r->org, org, sizeof(r->org));
+  int kz = 0;
+  for(int k=1;k<3;k++)
+    if(fabsf(dir[k]) > fabsf(dir[kz]))
+      kz = k;
+  int kx = (kz + 1) % 3, ky = (kx + 1) % 3;
+  // Swapping keeps the winding, so the sign of the edge functions stays
+  // meaningful for rays pointing down the dominant axis.
+  if(dir[kz] < 0) { int s = kx; kx = ky; ky = s; }
+  r->kx = kx; r->ky = ky; r->kz = kz;
+  r->sx = dir[kx] / dir[kz];
+  r->sy = dir[ky] / dir[kz];
+  r->sz = 1.0f / dir[kz];
+}
+
+// An edge function of exactly zero may be a float rounding artifact, so
+// it is recomputed in double to decide which side of the edge the ray is.
+static void edge_functions_double(float ax, float ay, float bx, float by, float cx, float cy,
+                                  float *u, float *v, float *w) {
+  *u = (float)((double)cx*by - (double)cy*bx);
+  *v = (float)((double)ax*cy - (double)ay*cx);
+  *w = (float)((double)bx*ay - (double)by*ax);
+}
+
+static void lane_normal(const tri_pack *p, int l, float n[3]) {
+  float e1[3], e2[3];
+  for(int k=0;k<3;k++) {
+    e1[k] = p->v1[k][l] - p->v0[k][l];
+    e2[k] = p->v2[k][l] - p->v0[k][l];
+  }
+  n[0] = e1[1]*e2[2] - e1[2]*e2[1];
+  n[1] = e1[2]*e2[0] - e1[0]*e2[2];
+  n[2] = e1[0]*e2[1] - e1[1]*e2[0];
+}
+
+// Watertight test against four triangles at once. Returns the lane mask
+// of hits closer than *tmax, updating *tmax and *hit for the nearest.
+static int intersect_pack(const tri_pack *p, const shear_ray *r, float *tmax, tri_hit *hit) {
+  int kx = r->kx, ky = r->ky, kz = r->kz;
+  __m128 ox = _mm_set1_ps(r->org[kx]), oy = _mm_set1_ps(r->org[ky]), oz = _mm_set1_ps(r->org[kz]);
+  __m128 sx = _mm_set1_ps(r->sx), sy = _mm_set1_ps(r->sy), sz = _mm_set1_ps(r->sz);
+
+  // Vertices relative to the origin, sheared into ray space.
+  __m128 az = _mm_sub_ps(_mm_load_ps(p->v0[kz]), oz);
+  __m128 bz = _mm_sub_ps(_mm_load_ps(p->v1[kz]), oz);
+  __m128 cz = _mm_sub_ps(_mm_load_ps(p->v2[kz]), oz);
+  __m128 ax = _mm_sub_ps(_mm_sub_ps(_mm_load_ps(p->v0[kx]), ox), _mm_mul_ps(sx, az));
+  __m128 ay = _mm_sub_ps(_mm_sub_ps(_mm_load_ps(p->v0[ky]), oy), _mm_mul_ps(sy, az));
+  __m128 bx = _mm_sub_ps(_mm_sub_ps(_mm_load_ps(p->v1[kx]), ox), _mm_mul_ps(sx, bz));
+  __m128 by = _mm_sub_ps(_mm_sub_ps(_mm_load_ps(p->v1[ky]), oy), _mm_mul_ps(sy, bz));
+  __m128 cx = _mm_sub_ps(_mm_sub_ps(_mm_load_ps(p->v2[kx]), ox), _mm_mul_ps(sx, cz));
+  __m128 cy = _mm_sub_ps(_mm_sub_ps(_mm_load_ps(p->v2[ky]), oy), _mm_mul_ps(sy, cz));
+
+  __m128 u = _mm_sub_ps(_mm_mul_ps(cx, by), _mm_mul_ps(cy, bx));
+  __m128 v = _mm_sub_ps(_mm_mul_ps(ax, cy), _mm_mul_ps(ay, cx));
+  __m128 w = _mm_sub_ps(_mm_mul_ps(bx, ay), _mm_mul_ps(by, ax));
+
+  __m128 zero = _mm_setzero_ps();
+  __m128 valid = _mm_castsi128_ps(_mm_cmpgt_epi32(_mm_load_si128((const __m128i *)p->id), _mm_set1_epi32(-1)));
+  __m128 on_edge = _mm_or_ps(_mm_or_ps(_mm_cmpeq_ps(u, zero), _mm_cmpeq_ps(v, zero)), _mm_cmpeq_ps(w, zero));
+  int redo = _mm_movemask_ps(_mm_and_ps(valid, on_edge));
+  if(redo) {
+    float axs[4], ays[4], bxs[4], bys[4], cxs[4], cys[4], us[4], vs[4], ws[4];
+    _mm_storeu_ps(axs, ax); _mm_storeu_ps(ays, ay);
+    _mm_storeu_ps(bxs, bx); _mm_storeu_ps(bys, by);
+    _mm_storeu_ps(cxs, cx); _mm_storeu_ps(cys, cy);
+    _mm_storeu_ps(us, u); _mm_storeu_ps(vs, v); _mm_storeu_ps(ws, w);
+    for(int l=0;l<4;l++)
+      if(redo & (1 << l))
+        edge_functions_double(axs[l], ays[l], bxs[l], bys[l], cxs[l], cys[l], &us[l], &vs[l], &ws[l]);
+    u = _mm_loadu_ps(us); v = _mm_loadu_ps(vs); w = _mm_loadu_ps(ws);
+  }
+
+  // Inside when no edge function disagrees in sign with another.
+  __m128 neg = _mm_or_ps(_mm_or_ps(_mm_cmplt_ps(u, zero), _mm_cmplt_ps(v, zero)), _mm_cmplt_ps(w, zero));
+  __m128 pos = _mm_or_ps(_mm_or_ps(_mm_cmpgt_ps(u, zero), _mm_cmpgt_ps(v, zero)), _mm_cmpgt_ps(w, zero));
+  __m128 det = _mm_add_ps(_mm_add_ps(u, v), w);
+  __m128 mask = _mm_andnot_ps(_mm_and_ps(neg, pos), valid);
+  mask = _mm_and_ps(mask, _mm_cmpneq_ps(det, zero));
+  if(!_mm_movemask_ps(mask))
+    return 0;
+
+  __m128 inv = _mm_div_ps(_mm_set1_ps(1.0f), det);
+  __m128 t = _mm_add_ps(_mm_add_ps(_mm_mul_ps(u, _mm_mul_ps(sz, az)), _mm_mul_ps(v, _mm_mul_ps(sz, bz))),
+                        _mm_mul_ps(w, _mm_mul_ps(sz, cz)));
+  t = _mm_mul_ps(t, inv);
+  mask = _mm_and_ps(mask, _mm_cmpgt_ps(t, _mm_set1_ps(TRI_T_MIN)));
+  mask = _mm_and_ps(mask, _mm_cmplt_ps(t, _mm_set1_ps(*tmax)));
+
+  int bits = _mm_movemask_ps(mask);
+  if(!bits)
+    return 0;
+
+  float ts[4], vs[4], ws[4];
+  _mm_storeu_ps(ts, t);
+  _mm_storeu_ps(vs, _mm_mul_ps(v, inv));
+  _mm_storeu_ps(ws, _mm_mul_ps(w, inv));
+  for(int l=0;l<4;l++) {
+    if((bits & (1 << l)) && ts[l] < *tmax) {
+      *tmax = ts[l];
+      hit->t = ts[l];
+      hit->u = vs[l];
+      hit->v = ws[l];
+      hit->id = p->id[l];
+      lane_normal(p, l, hit->normal);
+    }
+  }
+  return bits;
+}
+
+// Reference single-triangle version of intersect_pack, for the benchmark.
+static int intersect_scalar(const tri_pack *p, int l, const shear_ray *r, float *tmax) {
+  if(p->id[l] < 0)
+    return 0;
+  int kx = r->kx, ky = r->ky, kz = r->kz;
+  float az = p->v0[kz][l] - r->org[kz];
+  float bz = p->v1[kz][l] - r->org[kz];
+  float cz = p->v2[kz][l] - r->org[kz];
+  float ax = (p->v0[kx][l] - r->org[kx]) - r->sx*az;
+  float ay = (p->v0[ky][l] - r->org[ky]) - r->sy*az;
+  float bx = (p->v1[kx][l] - r->org[kx]) - r->sx*bz;
+  float by = (p->v1[ky][l] - r->org[ky]) - r->sy*bz;
+  float cx = (p->v2[kx][l] - r->org[kx]) - r->sx*cz;
+  float cy = (p->v2[ky][l] - r->org[ky]) - r->sy*cz;
+
+  float u = cx*by - cy*bx;
+  float v = ax*cy - ay*cx;
+  float w = bx*ay - by*ax;
+  if(u == 0 || v == 0 || w == 0)
+    edge_functions_double(ax, ay, bx, by, cx, cy, &u, &v, &w);
+
+  if((u < 0 || v < 0 || w < 0) && (u > 0 || v > 0 || w > 0))
+    return 0;
+  float det = u + v + w;
+  if(det == 0)
+    return 0;
+  float t = (u*(r->sz*az) + v*(r->sz*bz) + w*(r->sz*cz)) * (1.0f / det);
+  if(t <= TRI_T_MIN || t >= *tmax)
+    return 0;
+  *tmax = t;
+  return 1;
+}
+
+int intersect_tri_accel(const tri_accel *a, const float org[3], const float dir[3], float tmax, tri_hit *hit) {
+  if(!a->node_count)
+    return 0;
+
+  float inv[3];
+  for(int k=0;k<3;k++)
+    inv[k] = dir[k] != 0 ? 1.0f / dir[k] : (dir[k] < 0 ? -FLT_MAX : FLT_MAX);
+  shear_ray ray;
+  setup_shear_ray(&ray, org, dir);
+
+  int stack[BVH_STACK_DEPTH];
+  int top = 0;
+  int found = 0;
+  stack[top++] = 0;
+
+  while(top) {
+    const bvh_node *n = &a->nodes[stack[--top]];
+    if(!hit_box(n, org, inv, tmax))
+      continue;
+    if(n->count) {
+      for(int i=0;i<n->count;i++)
+        if(intersect_pack(&a->packs[n->first + i], &ray, &tmax, hit))
+          found = 1;
+    } else if(top + 2 <= BVH_STACK_DEPTH) {
+      stack[top++] = n->first;
+      stack[top++] = (int)(n - a->nodes) + 1;
+    }
+  }
+  return found;
+}
+
+static double now_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Brute-force rays against every pack, SIMD then scalar, so the numbers
+// measure the triangle test alone rather than BVH traversal.
+void benchmark_triangle_tests(const tri_accel *a, int rays) {
+  if(!a->pack_count)
+    return;
+
+  srand(1234);
+  float (*orgs)[3] = (float (*)[3])malloc(rays * sizeof(float[3]));
+  float (*dirs)[3] = (float (*)[3])malloc(rays * sizeof(float[3]));
+  for(int r=0;r<rays;r++) {
+    for(int k=0;k<3;k++)
+      orgs[r][k] = (rand() / (float)RAND_MAX - 0.5f) * 0.5f;
+    orgs[r][2] -= 5;
+    dirs[r][0] = dirs[r][1] = 0;
+    dirs[r][2] = 1;
+  }
+
+  long long tests = (long long)rays * a->pack_count * TRI_PACK_WIDTH;
+  float *nearest = (float *)malloc(rays * sizeof(float));
+  int hits = 0, mismatches = 0;
+
+  double start = now_seconds();
+  for(int r=0;r<rays;r++) {
+    float tmax = FLT_MAX;
+    tri_hit hit;
+    shear_ray ray;
+    setup_shear_ray(&ray, orgs[r], dirs[r]);
+    for(int p=0;p<a->pack_count;p++)
+      intersect_pack(&a->packs[p], &ray, &tmax, &hit);
+    nearest[r] = tmax;
+  }
+  double simd = now_seconds() - start;
+
+  start = now_seconds();
+  for(int r=0;r<rays;r++) {
+    float tmax = FLT_MAX;
+    shear_ray ray;
+    setup_shear_ray(&ray, orgs[r], dirs[r]);
+    for(int p=0;p<a->pack_count;p++)
+      for(int l=0;l<TRI_PACK_WIDTH;l++)
+        intersect_scalar(&a->packs[p], l, &ray, &tmax);
+    if(tmax < FLT_MAX)
+      hits++;
+    if(tmax != nearest[r])
+      mismatches++;
+  }
+  double scalar = now_seconds() - start;
+
+  fprintf(stderr, "triangle tests: SIMD %.1f M/s, scalar %.1f M/s (%.2fx) over %lld tests, %d/%d rays hit, %d mismatches\n",
+          tests / simd / 1e6, tests / scalar / 1e6, scalar / simd, tests, hits, rays, mismatches);
+
+  free(nearest);
+  free(orgs);
+  free(dirs);
+}
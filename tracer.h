@@ -0,0 +1,46 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include "mesh_loader.h"
+#include "matrix.h"
+
+#define TRI_PACK_WIDTH 4
+#define BVH_LEAF_TRIANGLES 8
+
+// Four triangles in SoA form, already in world space. v0[k] holds axis k
+// of the first vertex for each lane. The vertices are kept as loaded, not
+// as edges, so triangles sharing an edge see bit-identical endpoints and
+// the watertight test agrees along it. Unused lanes have id -1.
+struct alignas(16) tri_pack {
+  float v0[3][4], v1[3][4], v2[3][4];
+  int id[4];
+};
+
+// A leaf has count > 0 packs starting at 'first'; an interior node has
+// its left child next to it and its right child at 'first'.
+struct bvh_node {
+  float lo[3], hi[3];
+  int first;
+  int count;
+};
+
+struct tri_accel {
+  bvh_node *nodes;
+  int node_count;
+  tri_pack *packs;
+  int pack_count;
+  int triangle_count;
+};
+
+struct tri_hit {
+  float t, u, v;
+  int id;
+  float normal[3];
+};
+
+int build_tri_accel(tri_accel *a, const triangle_list *tris, const mat4 &transform);
+int intersect_tri_accel(const tri_accel *a, const float org[3], const float dir[3], float tmax, tri_hit *hit);
+void free_tri_accel(tri_accel *a);
+void benchmark_triangle_tests(const tri_accel *a, int rays);
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef UNIFORM_BLOCKS_H
+#define UNIFORM_BLOCKS_H
+
+#include "matrix.h"
+
+// CPU mirrors of the std140 blocks in uniforms.glsl. Keep both in sync:
+// vec3 members are padded to vec4 and every block is a multiple of 16
+// bytes.
+#define FRAME_BLOCK_BINDING 0
+#define VIEW_BLOCK_BINDING 1
+#define MATERIAL_BLOCK_BINDING 2
+#define OBJECT_BLOCK_BINDING 3
+
+struct frame_block {
+  float time;
+  float delta;
+  float pad[2];
+  float light_position[4];
+  float light_color[4];
+};
+
+struct view_block {
+  mat4 view;
+  float eye[4];
+  float viewport[4];
+};
+
+struct material_block {
+  float color[4];
+  float ambient, diffuse, specular, shininess;
+};
+
+struct object_block {
+  mat4 transform;
+};
+
+#endif
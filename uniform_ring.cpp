@@ -0,0 +1,116 @@
+#include "uniform_ring.h"
+#include "uniform_blocks.h"
+#include "gl_state.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int uniform_ring_init(uniform_ring *r, GLsizeiptr region_size, int regions) {
+  if(regions > UNIFORM_RING_MAX_REGIONS)
+    regions = UNIFORM_RING_MAX_REGIONS;
+  if(regions < 1)
+    regions = 1;
+
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &r->alignment);
+  if(r->alignment <= 0)
+    r->alignment = 256;
+  region_size = (region_size + r->alignment - 1) / r->alignment * r->alignment;
+
+  r->region_size = region_size;
+  r->regions = regions;
+  r->current = 0;
+  r->used = 0;
+  r->uploaded = 0;
+  r->staging = (unsigned char *)malloc(region_size);
+  for(int i=0;i<UNIFORM_RING_MAX_REGIONS;i++)
+    r->fences[i] = 0;
+
+  glGenBuffers(1, &r->buffer);
+  state_bind_buffer(GL_UNIFORM_BUFFER, r->buffer);
+  glBufferData(GL_UNIFORM_BUFFER, region_size * regions, NULL, GL_STREAM_DRAW);
+  state_bind_buffer(GL_UNIFORM_BUFFER, 0);
+  return r->staging != NULL;
+}
+
+void uniform_ring_begin_frame(uniform_ring *r) {
+  r->current = (r->current + 1) % r->regions;
+  GLsync fence = r->fences[r->current];
+  if(fence) {
+    glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+    glDeleteSync(fence);
+    r->fences[r->current] = 0;
+  }
+  r->used = 0;
+  r->uploaded = 0;
+}
+
+// Stages a block and returns its offset within the current region. All
+// pushes must happen before uniform_ring_upload.
+GLintptr uniform_ring_push(uniform_ring *r, const void *data, GLsizeiptr size) {
+  GLsizeiptr offset = (r->used + r->alignment - 1) / r->alignment * r->alignment;
+  if(r->uploaded || offset + size > r->region_size) {
+    fprintf(stderr, "uniform ring: %s, dropping %ld byte block\n",
+            r->uploaded ? "push after upload" : "region full", (long)size);
+    return -1;
+  }
+  memcpy(r->staging + offset, data, size);
+  r->used = offset + size;
+  return offset;
+}
+
+void uniform_ring_upload(uniform_ring *r) {
+  if(r->uploaded || r->used == 0)
+    return;
+
+  GLintptr base = r->current * r->region_size;
+  state_bind_buffer(GL_UNIFORM_BUFFER, r->buffer);
+  void *dst = glMapBufferRange(GL_UNIFORM_BUFFER, base, r->used,
+                               GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+  if(dst) {
+    memcpy(dst, r->staging, r->used);
+    glUnmapBuffer(GL_UNIFORM_BUFFER);
+  } else {
+    glBufferSubData(GL_UNIFORM_BUFFER, base, r->used, r->staging);
+  }
+  state_bind_buffer(GL_UNIFORM_BUFFER, 0);
+  r->uploaded = 1;
+}
+
+void uniform_ring_bind(uniform_ring *r, GLuint binding, GLintptr offset, GLsizeiptr size) {
+  if(offset < 0)
+    return;
+  state_bind_buffer_range(GL_UNIFORM_BUFFER, binding, r->buffer, r->current * r->region_size + offset, size);
+}
+
+void uniform_ring_end_frame(uniform_ring *r) {
+  r->fences[r->current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void uniform_ring_destroy(uniform_ring *r) {
+  for(int i=0;i<UNIFORM_RING_MAX_REGIONS;i++) {
+    if(r->fences[i])
+      glDeleteSync(r->fences[i]);
+    r->fences[i] = 0;
+  }
+  state_forget_buffer(r->buffer);
+  glDeleteBuffers(1, &r->buffer);
+  free(r->staging);
+  r->buffer = 0;
+  r->staging = NULL;
+}
+
+// GLSL 3.30 has no layout(binding = N), so blocks are attached to their
+// binding points by name after every link.
+void bind_uniform_blocks(GLuint program) {
+  static const struct { const char *name; GLuint binding; } blocks[] = {
+    { "Frame", FRAME_BLOCK_BINDING },
+    { "View", VIEW_BLOCK_BINDING },
+    { "Material", MATERIAL_BLOCK_BINDING },
+    { "Object", OBJECT_BLOCK_BINDING }
+  };
+  for(unsigned i=0;i<sizeof(blocks)/sizeof(blocks[0]);i++) {
+    GLuint index = glGetUniformBlockIndex(program, blocks[i].name);
+    if(index != GL_INVALID_INDEX)
+      glUniformBlockBinding(program, index, blocks[i].binding);
+  }
+}
@@ -0,0 +1,37 @@
+#ifndef UNIFORM_RING_H
+#define UNIFORM_RING_H
+
+#include <glad/glad.h>
+
+#define UNIFORM_RING_MAX_REGIONS 4
+
+// One uniform buffer allocated once and split into per-frame regions used
+// round-robin. Blocks are staged on the CPU during the frame, copied into
+// the region with a single unsynchronized map, and bound with
+// glBindBufferRange. A fence per region keeps us from overwriting data
+// the GPU is still reading.
+struct uniform_ring {
+  GLuint buffer;
+  GLsizeiptr region_size;
+  int regions;
+  int current;
+  GLint alignment;
+
+  unsigned char *staging;
+  GLsizeiptr used;
+  int uploaded;
+
+  GLsync fences[UNIFORM_RING_MAX_REGIONS];
+};
+
+int uniform_ring_init(uniform_ring *r, GLsizeiptr region_size, int regions);
+void uniform_ring_begin_frame(uniform_ring *r);
+GLintptr uniform_ring_push(uniform_ring *r, const void *data, GLsizeiptr size);
+void uniform_ring_upload(uniform_ring *r);
+void uniform_ring_bind(uniform_ring *r, GLuint binding, GLintptr offset, GLsizeiptr size);
+void uniform_ring_end_frame(uniform_ring *r);
+void uniform_ring_destroy(uniform_ring *r);
+
+void bind_uniform_blocks(GLuint program);
+
+#endif
@@ -0,0 +1,25 @@
+// std140 blocks shared by every program. Mirrored in uniform_blocks.h.
+layout (std140) uniform Frame {
+  float time;
+  float delta;
+  vec4 lightPosition;
+  vec4 lightColor;
+};
+
+layout (std140) uniform View {
+  mat4 view;
+  vec4 eye;
+  vec4 viewport;
+};
+
+layout (std140) uniform Material {
+  vec4 materialColor;
+  float ambient;
+  float diffuse;
+  float specular;
+  float shininess;
+};
+
+layout (std140) uniform Object {
+  mat4 transform;
+};
@@ -0,0 +1,187 @@
+#include "vertex_format.h"
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <emmintrin.h>
+
+static int attrib_size(attrib_format format) {
+  switch(format) {
+  case ATTRIB_FLOAT2: return 8;
+  case ATTRIB_FLOAT3: return 12;
+  case ATTRIB_HALF2: return 4;
+  case ATTRIB_USHORT2_NORM: return 4;
+  case ATTRIB_SHORT4_NORM: return 8;
+  case ATTRIB_UBYTE4_NORM: return 4;
+  }
+  return 0;
+}
+
+void vertex_layout_init(vertex_layout *l) {
+  l->count = 0;
+  l->stride = 0;
+  l->dequantize = mat4_identity();
+}
+
+void vertex_layout_add(vertex_layout *l, GLuint location, attrib_format format, int source_offset, int source_count) {
+  if(l->count == VERTEX_MAX_ATTRIBS)
+    return;
+  vertex_attrib *a = &l->attribs[l->count++];
+  a->location = location;
+  a->format = format;
+  a->source_offset = source_offset;
+  a->source_count = source_count;
+  a->offset = l->stride;
+  // Keep every attribute 4-byte aligned; some drivers fall off the fast
+  // path otherwise.
+  l->stride += (attrib_size(format) + 3) & ~3;
+}
+
+// Computes the bounds of the source positions and the matrix that undoes
+// the quantization to [-1,1].
+void vertex_layout_fit_positions(vertex_layout *l, const float *src, int src_stride, int count, int position_offset) {
+  float lo[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+  float hi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+  for(int i=0;i<count;i++) {
+    const float *p = src + i*src_stride + position_offset;
+    for(int k=0;k<3;k++) {
+      if(p[k] < lo[k]) lo[k] = p[k];
+      if(p[k] > hi[k]) hi[k] = p[k];
+    }
+  }
+  float center[3], half[3];
+  for(int k=0;k<3;k++) {
+    center[k] = count ? (lo[k] + hi[k]) * 0.5f : 0;
+    half[k] = count ? (hi[k] - lo[k]) * 0.5f : 1;
+    if(half[k] <= 0) half[k] = 1;
+  }
+  l->dequantize = mat4_multiply(mat4_translate(center[0], center[1], center[2]),
+                                mat4_scale(half[0], half[1], half[2]));
+}
+
+void vertex_layout_apply(const vertex_layout *l, GLintptr base) {
+  for(int i=0;i<l->count;i++) {
+    const vertex_attrib *a = &l->attribs[i];
+    void *offset = (void *)(base + a->offset);
+    switch(a->format) {
+    case ATTRIB_FLOAT2:
+      glVertexAttribPointer(a->location, 2, GL_FLOAT, GL_FALSE, l->stride, offset);
+      break;
+    case ATTRIB_FLOAT3:
+      glVertexAttribPointer(a->location, 3, GL_FLOAT, GL_FALSE, l->stride, offset);
+      break;
+    case ATTRIB_HALF2:
+      glVertexAttribPointer(a->location, 2, GL_HALF_FLOAT, GL_FALSE, l->stride, offset);
+      break;
+    case ATTRIB_USHORT2_NORM:
+      glVertexAttribPointer(a->location, 2, GL_UNSIGNED_SHORT, GL_TRUE, l->stride, offset);
+      break;
+    case ATTRIB_SHORT4_NORM:
+      glVertexAttribPointer(a->location, 4, GL_SHORT, GL_TRUE, l->stride, offset);
+      break;
+    case ATTRIB_UBYTE4_NORM:
+      glVertexAttribPointer(a->location, 4, GL_UNSIGNED_BYTE, GL_TRUE, l->stride, offset);
+      break;
+    }
+    glEnableVertexAttribArray(a->location);
+  }
+}
+
+// Four floats to four halves with round-to-nearest-even. Values below the
+// smallest normal half flush to zero and values past 65504 become
+// infinity; vertex data never needs either.
+static __m128i float_to_half4(__m128 v) {
+  __m128i x = _mm_castps_si128(v);
+  __m128i sign = _mm_and_si128(x, _mm_set1_epi32(0x80000000));
+  x = _mm_xor_si128(x, sign);
+
+  __m128i lsb = _mm_and_si128(_mm_srli_epi32(x, 13), _mm_set1_epi32(1));
+  __m128i h = _mm_add_epi32(x, _mm_set1_epi32(0xC8000FFF)); // -0x38000000 + 0xFFF
+  h = _mm_srli_epi32(_mm_add_epi32(h, lsb), 13);
+
+  __m128i tiny = _mm_cmplt_epi32(x, _mm_set1_epi32(0x38800000));
+  __m128i huge = _mm_cmpgt_epi32(x, _mm_set1_epi32(0x477FEFFF));
+  h = _mm_andnot_si128(tiny, h);
+  h = _mm_or_si128(_mm_andnot_si128(huge, h), _mm_and_si128(huge, _mm_set1_epi32(0x7C00)));
+  h = _mm_or_si128(h, _mm_srli_epi32(sign, 16));
+
+  // Sign-extend the low 16 bits so the saturating pack passes them
+  // through unchanged.
+  h = _mm_srai_epi32(_mm_slli_epi32(h, 16), 16);
+  return _mm_packs_epi32(h, h);
+}
+
+static __m128 clamp4(__m128 v, float lo, float hi) {
+  return _mm_min_ps(_mm_max_ps(v, _mm_set1_ps(lo)), _mm_set1_ps(hi));
+}
+
+static void pack_attrib(const vertex_attrib *a, __m128 v, unsigned char *dst) {
+  __m128i packed;
+  switch(a->format) {
+  case ATTRIB_FLOAT2:
+    _mm_storel_pi((__m64 *)dst, v);
+    break;
+  case ATTRIB_FLOAT3: {
+    float tmp[4];
+    _mm_storeu_ps(tmp, v);
+    memcpy(dst, tmp, 12);
+    break;
+  }
+  case ATTRIB_HALF2:
+    packed = float_to_half4(v);
+    *(int *)dst = _mm_cvtsi128_si32(packed);
+    break;
+  case ATTRIB_USHORT2_NORM:
+    // No unsigned 32->16 pack before SSE4.1: bias into signed range,
+    // pack, and flip the top bit back.
+    packed = _mm_cvtps_epi32(_mm_mul_ps(clamp4(v, 0, 1), _mm_set1_ps(65535.0f)));
+    packed = _mm_sub_epi32(packed, _mm_set1_epi32(32768));
+    packed = _mm_xor_si128(_mm_packs_epi32(packed, packed), _mm_set1_epi16((short)0x8000));
+    *(int *)dst = _mm_cvtsi128_si32(packed);
+    break;
+  case ATTRIB_SHORT4_NORM:
+    packed = _mm_cvtps_epi32(_mm_mul_ps(clamp4(v, -1, 1), _mm_set1_ps(32767.0f)));
+    packed = _mm_packs_epi32(packed, packed);
+    _mm_storel_epi64((__m128i *)dst, packed);
+    break;
+  case ATTRIB_UBYTE4_NORM:
+    packed = _mm_cvtps_epi32(_mm_mul_ps(clamp4(v, 0, 1), _mm_set1_ps(255.0f)));
+    packed = _mm_packs_epi32(packed, packed);
+    packed = _mm_packus_epi16(packed, packed);
+    *(int *)dst = _mm_cvtsi128_si32(packed);
+    break;
+  }
+}
+
+// Converts 'count' interleaved float vertices into the packed layout.
+// Quantized positions are mapped through the inverse of l->dequantize.
+void pack_vertices(const vertex_layout *l, const float *src, int src_stride, int count, void *dst) {
+  unsigned char *out = (unsigned char *)dst;
+  __m128 qscale = _mm_setr_ps(1.0f / l->dequantize.m[0], 1.0f / l->dequantize.m[5], 1.0f / l->dequantize.m[10], 0);
+  __m128 qbias = _mm_setr_ps(l->dequantize.m[12], l->dequantize.m[13], l->dequantize.m[14], 0);
+
+  memset(out, 0, (size_t)l->stride * count);
+  for(int i=0;i<count;i++) {
+    const float *v = src + i*src_stride;
+    for(int j=0;j<l->count;j++) {
+      const vertex_attrib *a = &l->attribs[j];
+      float tmp[4] = { 0, 0, 0, 1 };
+      memcpy(tmp, v + a->source_offset, a->source_count * sizeof(float));
+      __m128 x = _mm_loadu_ps(tmp);
+      if(a->format == ATTRIB_SHORT4_NORM)
+        x = _mm_mul_ps(_mm_sub_ps(x, qbias), qscale);
+      pack_attrib(a, x, out + a->offset);
+    }
+    out += l->stride;
+  }
+}
+
+// Position, color and uv from the 8-float mesh vertex: 20 bytes with
+// float positions or 16 with quantized ones, against 32 unpacked.
+vertex_layout compact_mesh_layout(int quantize_positions) {
+  vertex_layout l;
+  vertex_layout_init(&l);
+  vertex_layout_add(&l, 0, quantize_positions ? ATTRIB_SHORT4_NORM : ATTRIB_FLOAT3, 0, 3);
+  vertex_layout_add(&l, 1, ATTRIB_UBYTE4_NORM, 3, 3);
+  vertex_layout_add(&l, 2, ATTRIB_HALF2, 6, 2);
+  return l;
+}
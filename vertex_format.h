@@ -0,0 +1,45 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include <glad/glad.h>
+#include "matrix.h"
+
+#define VERTEX_MAX_ATTRIBS 8
+
+enum attrib_format {
+  ATTRIB_FLOAT2,
+  ATTRIB_FLOAT3,
+  ATTRIB_HALF2,        // GL_HALF_FLOAT
+  ATTRIB_USHORT2_NORM, // [0,1] in 16 bits, for UVs that stay in range
+  ATTRIB_SHORT4_NORM,  // quantized positions, see vertex_layout.dequantize
+  ATTRIB_UBYTE4_NORM   // colors
+};
+
+struct vertex_attrib {
+  GLuint location;
+  attrib_format format;
+  int source_offset;   // in floats, within the interleaved source vertex
+  int source_count;    // components read from the source
+  int offset;          // in bytes, within the packed vertex
+};
+
+// Declarative description of a packed vertex. Attributes are added in
+// order; vertex_layout_apply issues the matching glVertexAttribPointer
+// calls. When positions are quantized, 'dequantize' maps the [-1,1] short
+// range back to model space and belongs in the object's transform.
+struct vertex_layout {
+  vertex_attrib attribs[VERTEX_MAX_ATTRIBS];
+  int count;
+  int stride;
+  mat4 dequantize;
+};
+
+void vertex_layout_init(vertex_layout *l);
+void vertex_layout_add(vertex_layout *l, GLuint location, attrib_format format, int source_offset, int source_count);
+void vertex_layout_fit_positions(vertex_layout *l, const float *src, int src_stride, int count, int position_offset);
+void vertex_layout_apply(const vertex_layout *l, GLintptr base);
+void pack_vertices(const vertex_layout *l, const float *src, int src_stride, int count, void *dst);
+
+vertex_layout compact_mesh_layout(int quantize_positions);
+
+#endif
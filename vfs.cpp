@@ -0,0 +1,236 @@
+#include "vfs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// A mounted pack, or a loose directory when map is NULL. Packs built
+// into the executable are not owned and never unmapped.
+struct vfs_mount_point {
+  char *path;
+  const char *map;
+  size_t size;
+  int owned;
+  const vfs_pack_entry *entries;
+  const char *names;
+  uint32_t entry_count;
+};
+
+static vfs_mount_point mounts[VFS_MAX_MOUNTS];
+static int mount_count;
+
+static const char *skip_dot_slash(const char *name) {
+  while(name[0] == '.' && name[1] == '/')
+    name += 2;
+  return name;
+}
+
+// FNV-1a, over the name as the pack tool stores it.
+uint64_t vfs_hash(const char *name) {
+  uint64_t h = 14695981039346656037ull;
+  for(const unsigned char *p = (const unsigned char *)skip_dot_slash(name); *p; p++) {
+    h ^= *p;
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+static const char *map_whole_file(const char *path, size_t *size) {
+  int fd = open(path, O_RDONLY);
+  if(fd < 0)
+    return NULL;
+  struct stat st;
+  if(fstat(fd, &st) < 0 || st.st_size == 0) {
+    close(fd);
+    return NULL;
+  }
+  void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(p == MAP_FAILED)
+    return NULL;
+  *size = st.st_size;
+  return (const char *)p;
+}
+
+static int valid_pack(const char *map, size_t size) {
+  const vfs_pack_header *h = (const vfs_pack_header *)map;
+  if(size < sizeof(*h) || (uintptr_t)map % 8 || h->magic != VFS_PACK_MAGIC || h->version != VFS_PACK_VERSION)
+    return 0;
+  if((uint64_t)h->entry_count * sizeof(vfs_pack_entry) > size - sizeof(*h))
+    return 0;
+  if(h->names_offset > size || h->names_size > size - h->names_offset ||
+     (h->names_size && map[h->names_offset + h->names_size - 1] != '\0'))
+    return 0;
+  const vfs_pack_entry *e = (const vfs_pack_entry *)(h + 1);
+  for(uint32_t i=0;i<h->entry_count;i++) {
+    if(e[i].offset > size || e[i].size >= size - e[i].offset || e[i].name_offset >= h->names_size)
+      return 0;
+    if(i && e[i].hash < e[i-1].hash)
+      return 0;
+  }
+  return 1;
+}
+
+static int attach_pack(vfs_mount_point *m) {
+  if(!valid_pack(m->map, m->size))
+    return 0;
+  const vfs_pack_header *h = (const vfs_pack_header *)m->map;
+  m->entries = (const vfs_pack_entry *)(h + 1);
+  m->entry_count = h->entry_count;
+  m->names = m->map + h->names_offset;
+  return 1;
+}
+
+// Adds a pack file or a loose directory to the search list. Names are
+// looked up in mount order, then as plain paths from the working
+// directory. Mount everything before any loader threads start.
+int vfs_mount(const char *path) {
+  if(mount_count == VFS_MAX_MOUNTS) {
+    fprintf(stderr, "vfs: too many mounts for %s\n", path);
+    return 0;
+  }
+  struct stat st;
+  if(stat(path, &st) < 0) {
+    fprintf(stderr, "vfs: cannot mount %s\n", path);
+    return 0;
+  }
+  vfs_mount_point *m = &mounts[mount_count];
+  memset(m, 0, sizeof(*m));
+  if(!S_ISDIR(st.st_mode)) {
+    m->map = map_whole_file(path, &m->size);
+    m->owned = 1;
+    if(!m->map || !attach_pack(m)) {
+      fprintf(stderr, "vfs: %s is not a pack file\n", path);
+      if(m->map)
+        munmap((void *)m->map, m->size);
+      return 0;
+    }
+  }
+  m->path = strdup(path);
+  mount_count++;
+  return 1;
+}
+
+// Mounts a pack image that is already in memory, such as the one pack
+// --cpp compiles into the executable. The data must outlive the mount.
+int vfs_mount_memory(const char *name, const void *data, size_t size) {
+  if(mount_count == VFS_MAX_MOUNTS) {
+    fprintf(stderr, "vfs: too many mounts for %s\n", name);
+    return 0;
+  }
+  vfs_mount_point *m = &mounts[mount_count];
+  memset(m, 0, sizeof(*m));
+  m->map = (const char *)data;
+  m->size = size;
+  if(!attach_pack(m)) {
+    fprintf(stderr, "vfs: %s is not a pack image\n", name);
+    return 0;
+  }
+  m->path = strdup(name);
+  mount_count++;
+  return 1;
+}
+
+void vfs_unmount_all() {
+  for(int i=0;i<mount_count;i++) {
+    if(mounts[i].owned)
+      munmap((void *)mounts[i].map, mounts[i].size);
+    free(mounts[i].path);
+  }
+  mount_count = 0;
+}
+
+static const vfs_pack_entry *find_entry(const vfs_mount_point *m, const char *name, uint64_t hash) {
+  int lo = 0, hi = (int)m->entry_count;
+  while(lo < hi) {
+    int mid = (lo + hi) / 2;
+    if(m->entries[mid].hash < hash)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  for(;lo < (int)m->entry_count && m->entries[lo].hash == hash;lo++)
+    if(!strcmp(m->names + m->entries[lo].name_offset, name))
+      return &m->entries[lo];
+  return NULL;
+}
+
+static int open_loose(const char *path, vfs_file *f) {
+  f->map = (void *)map_whole_file(path, &f->map_size);
+  if(!f->map)
+    return 0;
+  f->data = (const char *)f->map;
+  f->size = f->map_size;
+  return 1;
+}
+
+// Opens name for reading without copying it. Returns 0 (quietly) if no
+// mount and no loose file has it.
+int vfs_open(const char *name, vfs_file *f) {
+  memset(f, 0, sizeof(*f));
+  name = skip_dot_slash(name);
+  uint64_t hash = vfs_hash(name);
+  for(int i=0;i<mount_count;i++) {
+    const vfs_mount_point *m = &mounts[i];
+    if(m->map) {
+      const vfs_pack_entry *e = find_entry(m, name, hash);
+      if(e) {
+        f->data = m->map + e->offset;
+        f->size = e->size;
+        return 1;
+      }
+    } else if(name[0] != '/') {
+      char path[1024];
+      snprintf(path, sizeof(path), "%s/%s", m->path, name);
+      if(open_loose(path, f))
+        return 1;
+    }
+  }
+  return open_loose(name, f);
+}
+
+// As vfs_open, but a loose file in the working directory wins over every
+// mount. Shader hot reload reads through this so that an edited file is
+// seen rather than its packed or built-in copy; other lookups are unchanged.
+int vfs_open_loose(const char *name, vfs_file *f) {
+  memset(f, 0, sizeof(*f));
+  if(open_loose(skip_dot_slash(name), f))
+    return 1;
+  return vfs_open(name, f);
+}
+
+int vfs_exists(const char *name) {
+  name = skip_dot_slash(name);
+  uint64_t hash = vfs_hash(name);
+  char path[1024];
+  for(int i=0;i<mount_count;i++) {
+    const vfs_mount_point *m = &mounts[i];
+    if(m->map) {
+      if(find_entry(m, name, hash))
+        return 1;
+    } else if(name[0] != '/') {
+      snprintf(path, sizeof(path), "%s/%s", m->path, name);
+      if(access(path, R_OK) == 0)
+        return 1;
+    }
+  }
+  return access(name, R_OK) == 0;
+}
+
+// madvise over the pages holding the file.
+void vfs_advise(const vfs_file *f, int advice) {
+  if(!f->size)
+    return;
+  uintptr_t page = sysconf(_SC_PAGESIZE);
+  uintptr_t start = (uintptr_t)f->data & ~(page - 1);
+  madvise((void *)start, (uintptr_t)f->data + f->size - start, advice);
+}
+
+void vfs_close(vfs_file *f) {
+  if(f->map)
+    munmap(f->map, f->map_size);
+  memset(f, 0, sizeof(*f));
+}
@@ -0,0 +1,53 @@
+#ifndef VFS_H
+#define VFS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Pack file written by the pack tool: a header, the entry table sorted by
+// name hash, the NUL-terminated names, then the data. Each entry's data is
+// followed by a zero byte (not counted in its size) so text can be used
+// as a C string, and entries of a page or more start on a page boundary
+// so their alignment matches a loose file's mapping.
+#define VFS_PACK_MAGIC 0x4B415054u /* "TPAK" */
+#define VFS_PACK_VERSION 1
+#define VFS_PACK_ALIGNMENT 16
+#define VFS_PACK_PAGE 4096
+#define VFS_MAX_MOUNTS 8
+
+struct vfs_pack_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t entry_count;
+  uint32_t names_size;
+  uint64_t names_offset;
+};
+
+struct vfs_pack_entry {
+  uint64_t hash;
+  uint64_t offset, size;
+  uint32_t name_offset;
+  uint32_t reserved;
+};
+
+// Read-only view of a file's bytes. Points into a mounted pack, or into a
+// private mapping of a loose file that vfs_close releases. Only pack
+// entries are NUL-terminated; go by size.
+struct vfs_file {
+  const char *data;
+  size_t size;
+  void *map;
+  size_t map_size;
+};
+
+uint64_t vfs_hash(const char *name);
+int vfs_mount(const char *path);
+int vfs_mount_memory(const char *name, const void *data, size_t size);
+void vfs_unmount_all();
+int vfs_exists(const char *name);
+int vfs_open(const char *name, vfs_file *f);
+int vfs_open_loose(const char *name, vfs_file *f);
+void vfs_advise(const vfs_file *f, int advice);
+void vfs_close(vfs_file *f);
+
+#endif
@@ -0,0 +1,17 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec4 vertexColor;
+in vec2 texCoord;
+
+#include "virtual_texture.glsl"
+
+void main()
+{
+  vec2 uv = vec2(texCoord.x, -texCoord.y);
+#ifdef FEEDBACK
+  FragColor = vt_feedback(uv);
+#else
+  FragColor = vt_sample(uv);
+#endif
+}
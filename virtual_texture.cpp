@@ -0,0 +1,342 @@
+#include "virtual_texture.h"
+#include "gl_state.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#define VT_DEFAULT_UPLOADS_PER_FRAME 8
+#define VT_PINNED INT_MAX
+
+struct vt_request {
+  int page;
+  int level;
+};
+
+static int page_level(const virtual_texture *vt, int page) {
+  int l = vt->levels - 1;
+  while(l > 0 && page < vt->level_base[l])
+    l--;
+  return l;
+}
+
+static void upload_page(virtual_texture *vt, int page, int slot) {
+  int l = page_level(vt, page);
+  const unsigned char *data = (const unsigned char *)vt->file + vt->file->level_offset[l] +
+    (size_t)(page - vt->level_base[l]) * VIRTUAL_PAGE_BYTES;
+  state_bind_texture(0, GL_TEXTURE_2D, vt->cache_texture);
+  state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, (slot % vt->cache_pages) * VIRTUAL_PAGE_STRIDE,
+                  (slot / vt->cache_pages) * VIRTUAL_PAGE_STRIDE, VIRTUAL_PAGE_STRIDE, VIRTUAL_PAGE_STRIDE,
+                  GL_RGBA, GL_UNSIGNED_BYTE, data);
+  vt->slots[slot].page = page;
+  vt->page_slot[page] = slot;
+  vt->indirection_dirty = 1;
+  vt->uploads++;
+}
+
+// Page of the next level covering page p. Odd sizes can leave the last
+// page of a level without a parent of its own; it shares the last one.
+static int parent_page(int parent_pages, int p) {
+  p /= 2;
+  return p < parent_pages ? p : parent_pages - 1;
+}
+
+static GLuint make_texture(int width, int height, GLint filter) {
+  GLuint texture;
+  glGenTextures(1, &texture);
+  state_bind_texture(0, GL_TEXTURE_2D, texture);
+  state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+  state_tex_parameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+  state_tex_parameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+  state_tex_parameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  state_tex_parameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  return texture;
+}
+
+static void rebuild_indirection(virtual_texture *vt) {
+  for(int l=vt->levels-1;l>=0;l--) {
+    for(int y=0;y<vt->level_pages_y[l];y++) {
+      for(int x=0;x<vt->level_pages_x[l];x++) {
+        unsigned char *e = vt->indirection_data + (y*vt->indirection_width + vt->level_x[l] + x)*4;
+        int slot = vt->page_slot[vt->level_base[l] + y*vt->level_pages_x[l] + x];
+        if(slot >= 0) {
+          e[0] = slot % vt->cache_pages;
+          e[1] = slot / vt->cache_pages;
+          e[2] = l;
+          e[3] = 255;
+        } else {
+          int px = parent_page(vt->level_pages_x[l+1], x), py = parent_page(vt->level_pages_y[l+1], y);
+          memcpy(e, vt->indirection_data + (py*vt->indirection_width + vt->level_x[l+1] + px)*4, 4);
+        }
+      }
+    }
+  }
+  state_bind_texture(0, GL_TEXTURE_2D, vt->indirection);
+  state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, vt->indirection_width, vt->indirection_height,
+                  GL_RGBA, GL_UNSIGNED_BYTE, vt->indirection_data);
+  vt->indirection_dirty = 0;
+}
+
+// Marks a page and its ancestors as wanted this frame, queueing the ones
+// that are not resident.
+static void request_page(virtual_texture *vt, int level, int x, int y, vt_request *queue, int *count) {
+  for(;;) {
+    int page = vt->level_base[level] + y*vt->level_pages_x[level] + x;
+    if(vt->page_requested[page] == vt->frame)
+      return;
+    vt->page_requested[page] = vt->frame;
+    int slot = vt->page_slot[page];
+    if(slot >= 0) {
+      if(vt->slots[slot].last_used != VT_PINNED)
+        vt->slots[slot].last_used = vt->frame;
+    } else {
+      queue[*count].page = page;
+      queue[*count].level = level;
+      (*count)++;
+    }
+    if(++level == vt->levels)
+      return;
+    x = parent_page(vt->level_pages_x[level], x);
+    y = parent_page(vt->level_pages_y[level], y);
+  }
+}
+
+static int coarse_first(const void *a, const void *b) {
+  return ((const vt_request *)b)->level - ((const vt_request *)a)->level;
+}
+
+// Least recently used slot not needed this frame, or -1.
+static int free_slot(virtual_texture *vt) {
+  int best = -1;
+  for(int i=0;i<vt->cache_pages*vt->cache_pages;i++) {
+    vt_slot *s = &vt->slots[i];
+    if(s->page < 0)
+      return i;
+    if(s->last_used >= vt->frame)
+      continue;
+    if(best < 0 || s->last_used < vt->slots[best].last_used)
+      best = i;
+  }
+  return best;
+}
+
+static int process_feedback(virtual_texture *vt, const unsigned char *pixels, int count, vt_request *queue) {
+  int queued = 0;
+  for(int i=0;i<count;i++) {
+    const unsigned char *p = pixels + i*4;
+    if(!p[3])
+      continue;
+    int level = p[3] - 1;
+    int x = p[0] | (p[2] & 15) << 8, y = p[1] | (p[2] >> 4) << 8;
+    if(level >= vt->levels || x >= vt->level_pages_x[level] || y >= vt->level_pages_y[level])
+      continue;
+    request_page(vt, level, x, y, queue, &queued);
+  }
+  return queued;
+}
+
+int vt_open(virtual_texture *vt, const char *path, int cache_pages) {
+  memset(vt, 0, sizeof(*vt));
+  vt->file = map_virtual_texture_file(path, &vt->mapping);
+  if(!vt->file)
+    return 0;
+
+  GLint max_size;
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+  if(cache_pages * VIRTUAL_PAGE_STRIDE > max_size)
+    cache_pages = max_size / VIRTUAL_PAGE_STRIDE;
+  if(cache_pages > 256)
+    cache_pages = 256;
+
+  vt->levels = vt->file->level_count;
+  for(int l=0;l<vt->levels;l++) {
+    vt->level_pages_x[l] = virtual_level_pages(vt->file->width, l);
+    vt->level_pages_y[l] = virtual_level_pages(vt->file->height, l);
+    vt->level_base[l] = vt->page_count;
+    vt->level_x[l] = vt->indirection_width;
+    vt->page_count += vt->level_pages_x[l] * vt->level_pages_y[l];
+    vt->indirection_width += vt->level_pages_x[l];
+  }
+  vt->indirection_height = vt->level_pages_y[0];
+  if(vt->level_pages_x[0] > 4096 || vt->level_pages_y[0] > 4096 || vt->indirection_width > max_size) {
+    fprintf(stderr, "%s: %ux%u is too large for the page encoding\n", path, vt->file->width, vt->file->height);
+    vt_close(vt);
+    return 0;
+  }
+
+  vt->page_slot = (int *)malloc(vt->page_count * sizeof(int));
+  vt->page_requested = (int *)malloc(vt->page_count * sizeof(int));
+  for(int i=0;i<vt->page_count;i++) {
+    vt->page_slot[i] = -1;
+    vt->page_requested[i] = -1;
+  }
+
+  vt->cache_pages = cache_pages;
+  vt->slots = (vt_slot *)malloc(cache_pages * cache_pages * sizeof(vt_slot));
+  for(int i=0;i<cache_pages*cache_pages;i++) {
+    vt->slots[i].page = -1;
+    vt->slots[i].last_used = -1;
+  }
+  vt->cache_texture = make_texture(cache_pages * VIRTUAL_PAGE_STRIDE, cache_pages * VIRTUAL_PAGE_STRIDE, GL_LINEAR);
+  vt->indirection = make_texture(vt->indirection_width, vt->indirection_height, GL_NEAREST);
+  vt->indirection_data = (unsigned char *)calloc(vt->indirection_width * vt->indirection_height, 4);
+
+  glGenFramebuffers(1, &vt->feedback_fbo);
+  glGenBuffers(1, &vt->readback);
+  vt->uploads_per_frame = VT_DEFAULT_UPLOADS_PER_FRAME;
+
+  // The single page of the last level backs every lookup.
+  upload_page(vt, vt->level_base[vt->levels - 1], 0);
+  vt->slots[0].last_used = VT_PINNED;
+  rebuild_indirection(vt);
+  return 1;
+}
+
+// Consumes the feedback readback once the GPU has finished it: streams up
+// to uploads_per_frame missing pages (coarsest first, so there is always
+// a close fallback) and refreshes the indirection texture. Returns the
+// number of pages uploaded; the view needs redrawing when it is non-zero.
+// Pages left over are requested again by the next feedback pass.
+int vt_update(virtual_texture *vt) {
+  if(!vt->readback_fence)
+    return 0;
+  GLenum status = glClientWaitSync(vt->readback_fence, 0, 0);
+  if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+    return 0;
+  glDeleteSync(vt->readback_fence);
+  vt->readback_fence = 0;
+
+  int count = vt->readback_width * vt->readback_height;
+  state_bind_buffer(GL_PIXEL_PACK_BUFFER, vt->readback);
+  const unsigned char *pixels = (const unsigned char *)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, count * 4, GL_MAP_READ_BIT);
+  if(!pixels) {
+    state_bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+    return 0;
+  }
+  vt_request *queue = (vt_request *)malloc(vt->page_count * sizeof(vt_request));
+  int queued = process_feedback(vt, pixels, count, queue);
+  glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  state_bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  qsort(queue, queued, sizeof(vt_request), coarse_first);
+  int loaded = 0;
+  for(int i=0;i<queued && loaded<vt->uploads_per_frame;i++) {
+    int slot = free_slot(vt);
+    if(slot < 0)
+      break;
+    if(vt->slots[slot].page >= 0) {
+      vt->page_slot[vt->slots[slot].page] = -1;
+      vt->evictions++;
+    }
+    upload_page(vt, queue[i].page, slot);
+    vt->slots[slot].last_used = vt->frame;
+    loaded++;
+  }
+  vt->requests += queued;
+  vt->pending = queued - loaded;
+  free(queue);
+
+  if(vt->indirection_dirty)
+    rebuild_indirection(vt);
+  vt->frame++;
+  return loaded;
+}
+
+// Redirects drawing into the low resolution feedback target and returns 1,
+// or returns 0 while the previous feedback is still being read back; skip
+// the feedback pass then. Only one readback is ever in flight so that an
+// idle view stops asking for frames once its pages are resident.
+int vt_begin_feedback(virtual_texture *vt, int width, int height) {
+  if(vt->readback_fence)
+    return 0;
+  int fw = (width + VT_FEEDBACK_SCALE - 1) / VT_FEEDBACK_SCALE;
+  int fh = (height + VT_FEEDBACK_SCALE - 1) / VT_FEEDBACK_SCALE;
+  if(fw != vt->feedback_width || fh != vt->feedback_height) {
+    if(vt->feedback_color) {
+      state_forget_texture(vt->feedback_color);
+      glDeleteTextures(1, &vt->feedback_color);
+    }
+    vt->feedback_color = make_texture(fw, fh, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, vt->feedback_fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, vt->feedback_color, 0);
+    vt->feedback_width = fw;
+    vt->feedback_height = fh;
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, vt->feedback_fbo);
+  glViewport(0, 0, fw, fh);
+  glClearColor(0, 0, 0, 0);
+  glClear(GL_COLOR_BUFFER_BIT);
+  return 1;
+}
+
+// Starts an asynchronous readback of the feedback target and restores the
+// default framebuffer at width x height. vt_update picks the result up a
+// frame or two later, once its fence has passed.
+void vt_end_feedback(virtual_texture *vt, int width, int height) {
+  state_bind_buffer(GL_PIXEL_PACK_BUFFER, vt->readback);
+  glBufferData(GL_PIXEL_PACK_BUFFER, vt->feedback_width * vt->feedback_height * 4, NULL, GL_STREAM_READ);
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  glReadPixels(0, 0, vt->feedback_width, vt->feedback_height, GL_RGBA, GL_UNSIGNED_BYTE, (void *)0);
+  state_bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+  vt->readback_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  vt->readback_width = vt->feedback_width;
+  vt->readback_height = vt->feedback_height;
+
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glViewport(0, 0, width, height);
+}
+
+void vt_bind(virtual_texture *vt, GLuint program, int indirection_unit, int cache_unit, int feedback) {
+  state_use_program(program);
+  state_bind_texture(indirection_unit, GL_TEXTURE_2D, vt->indirection);
+  state_bind_texture(cache_unit, GL_TEXTURE_2D, vt->cache_texture);
+
+  glUniform1i(glGetUniformLocation(program, "vtIndirection"), indirection_unit);
+  glUniform1i(glGetUniformLocation(program, "vtCache"), cache_unit);
+  // Feedback renders at 1/VT_FEEDBACK_SCALE resolution, so its derivatives
+  // are that much larger; the bias brings its level choice back in line.
+  float bias = 0;
+  for(int s=VT_FEEDBACK_SCALE;feedback && s>1;s/=2)
+    bias -= 1;
+  glUniform4f(glGetUniformLocation(program, "vtSize"), vt->file->width, vt->file->height, vt->levels - 1, bias);
+  glUniform1f(glGetUniformLocation(program, "vtCacheSize"), vt->cache_pages * VIRTUAL_PAGE_STRIDE);
+  glUniform1iv(glGetUniformLocation(program, "vtLevelX"), vt->levels, vt->level_x);
+}
+
+void vt_report(virtual_texture *vt) {
+  int resident = 0;
+  for(int i=0;i<vt->cache_pages*vt->cache_pages;i++)
+    if(vt->slots[i].page >= 0)
+      resident++;
+  fprintf(stderr, "virtual texture: %d/%d pages resident in %d slots, %d requests, %d uploads, %d evictions\n",
+          resident, vt->page_count, vt->cache_pages * vt->cache_pages, vt->requests, vt->uploads, vt->evictions);
+}
+
+void vt_close(virtual_texture *vt) {
+  if(vt->readback_fence)
+    glDeleteSync(vt->readback_fence);
+  if(vt->readback) {
+    state_forget_buffer(vt->readback);
+    glDeleteBuffers(1, &vt->readback);
+  }
+  GLuint textures[3] = { vt->cache_texture, vt->indirection, vt->feedback_color };
+  for(int i=0;i<3;i++) {
+    if(textures[i]) {
+      state_forget_texture(textures[i]);
+      glDeleteTextures(1, &textures[i]);
+    }
+  }
+  if(vt->feedback_fbo)
+    glDeleteFramebuffers(1, &vt->feedback_fbo);
+  free(vt->page_slot);
+  free(vt->page_requested);
+  free(vt->slots);
+  free(vt->indirection_data);
+  vfs_close(&vt->mapping);
+  memset(vt, 0, sizeof(*vt));
+}
@@ -0,0 +1,55 @@
+// Virtual texture lookup; see virtual_texture.h. Pages are
+// VT_PAGE_SIZE texels with a VT_PAGE_BORDER border on every side.
+uniform sampler2D vtIndirection;
+uniform sampler2D vtCache;
+uniform vec4 vtSize;        // width, height, last level, level bias
+uniform float vtCacheSize;  // cache texture size in texels
+uniform int vtLevelX[16];   // first indirection column of each level
+
+const float VT_PAGE_SIZE = 128.0;
+const float VT_PAGE_BORDER = 4.0;
+const float VT_PAGE_STRIDE = 136.0;
+
+vec2 vt_level_size(int level)
+{
+  return max(floor(vtSize.xy / exp2(float(level))), vec2(1.0));
+}
+
+int vt_level(vec2 uv)
+{
+  vec2 texels = uv * vtSize.xy;
+  vec2 dx = dFdx(texels), dy = dFdy(texels);
+  float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + vtSize.w;
+  return int(clamp(floor(lod), 0.0, vtSize.z));
+}
+
+ivec2 vt_page(vec2 uv, int level)
+{
+  vec2 size = vt_level_size(level);
+  return ivec2(min(floor(uv * size / VT_PAGE_SIZE), ceil(size / VT_PAGE_SIZE) - 1.0));
+}
+
+vec4 vt_sample(vec2 uv)
+{
+  uv = clamp(uv, 0.0, 1.0);
+  int level = vt_level(uv);
+  ivec2 page = vt_page(uv, level);
+  vec4 entry = texelFetch(vtIndirection, ivec2(vtLevelX[level] + page.x, page.y), 0) * 255.0;
+
+  // The entry may point at a coarser ancestor; find our texel in it.
+  vec2 size = vt_level_size(int(entry.b + 0.5));
+  vec2 texel = min(uv * size, size - 0.5);
+  vec2 inPage = texel - floor(texel / VT_PAGE_SIZE) * VT_PAGE_SIZE;
+  vec2 cache = floor(entry.rg + 0.5) * VT_PAGE_STRIDE + VT_PAGE_BORDER + inPage;
+  return textureLod(vtCache, cache / vtCacheSize, 0.0);
+}
+
+// Written to the feedback target: page x/y low bits in r/g, their high
+// four bits in b, level + 1 in a (0 means nothing was drawn).
+vec4 vt_feedback(vec2 uv)
+{
+  uv = clamp(uv, 0.0, 1.0);
+  int level = vt_level(uv);
+  ivec2 page = vt_page(uv, level);
+  return vec4(page.x & 255, page.y & 255, (page.x >> 8) | ((page.y >> 8) << 4), level + 1) / 255.0;
+}
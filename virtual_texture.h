@@ -0,0 +1,66 @@
+#ifndef VIRTUAL_TEXTURE_H
+#define VIRTUAL_TEXTURE_H
+
+#include <glad/glad.h>
+#include "texture_file.h"
+
+#define VT_FEEDBACK_SCALE 8
+
+struct vt_slot {
+  int page;
+  int last_used;
+};
+
+// Sparse virtual texture over a texconv .vtex file. Only pages a feedback
+// pass reports as visible are copied from the mapping into a fixed cache
+// texture of cache_pages x cache_pages slots; an indirection texture (one
+// texel per page, all levels side by side) tells virtual_texture.glsl
+// which slot holds each page, or its nearest resident ancestor. The last
+// level is a single page that is always resident.
+//
+// Poll vt_update like the texture loader. When drawing, if
+// vt_begin_feedback agrees, draw the geometry bound with feedback = 1 and
+// call vt_end_feedback, then draw it for real bound with feedback = 0.
+struct virtual_texture {
+  const virtual_texture_header *file;
+  vfs_file mapping;
+
+  int levels;
+  int level_base[TEXTURE_FILE_MAX_LEVELS];
+  int level_pages_x[TEXTURE_FILE_MAX_LEVELS];
+  int level_pages_y[TEXTURE_FILE_MAX_LEVELS];
+  int level_x[TEXTURE_FILE_MAX_LEVELS];
+  int page_count;
+  int *page_slot;
+  int *page_requested;
+
+  int cache_pages;
+  vt_slot *slots;
+  GLuint cache_texture;
+
+  GLuint indirection;
+  int indirection_width, indirection_height;
+  unsigned char *indirection_data;
+  int indirection_dirty;
+
+  GLuint feedback_fbo, feedback_color;
+  int feedback_width, feedback_height;
+  GLuint readback;
+  GLsync readback_fence;
+  int readback_width, readback_height;
+
+  int frame;
+  int uploads_per_frame;
+  int pending;
+  int requests, uploads, evictions;
+};
+
+int vt_open(virtual_texture *vt, const char *path, int cache_pages);
+int vt_update(virtual_texture *vt);
+int vt_begin_feedback(virtual_texture *vt, int width, int height);
+void vt_end_feedback(virtual_texture *vt, int width, int height);
+void vt_bind(virtual_texture *vt, GLuint program, int indirection_unit, int cache_unit, int feedback);
+void vt_report(virtual_texture *vt);
+void vt_close(virtual_texture *vt);
+
+#endif